@@ -16,6 +16,9 @@ extern pcb_PTR removeBlocked(int *semAdd);
 extern pcb_PTR outBlocked(pcb_PTR p);
 extern pcb_PTR headBlocked(int *semAdd);
 extern void initASL();
+extern void setSemdLimit(int limit);
+extern void lockSemaphore(int *semAdd);
+extern void unlockSemaphore(int *semAdd);
 
 /***************************************************************/
 
@@ -7,4 +7,5 @@
     extern void translationLookasideBufferHandler();
     extern void contextSwitch(state_PTR s);
     extern void copyState(state_PTR from, state_PTR to);
+    extern void releaseMutexes(pcb_PTR p);
 #endif
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef HEAP
+#define HEAP
+
+/************************** HEAP.E *****************************
+*
+*  The externals declaration file for the Kernel Heap
+*    Module.
+*
+*/
+
+#include "../h/types.h"
+
+extern void initHeap ();
+extern memaddr heapEnd ();
+extern memaddr allocPages (int order);
+extern void freePages (memaddr block);
+
+extern void initCache (cache_t *cache, int size, int limit);
+extern void setCacheLimit (cache_t *cache, int limit);
+extern memaddr cacheAlloc (cache_t *cache);
+extern void cacheFree (cache_t *cache, memaddr object);
+
+/***************************************************************/
+
+#endif
@@ -4,14 +4,18 @@
 #define INITPROC
     pteOS_t kSegOS;
     pte_t kUseg3;
-    swapPool_t pool[100];
+    unsigned int kUseg3Backed;
     Tproc_t uProcesses[MAXUPROC];
     int next;
-    int disk1Semaphore;
-    int disk0Semaphore;
-    int swapSemaphore;
+    mutex_t diskSemaphores[DEVPERINT];
+    mutex_t tapeSemaphores[DEVPERINT];
+    int tapePos[DEVPERINT];
+    mutex_t swapSemaphore;
     int masterSemaphore;
-    int mutexSemaphores[MAXSEMALLOC];
+    mutex_t mutexSemaphores[MAXSEMALLOC];
     int extractASID();
     void invalidateEntry();
+    void forkedUProc();
+    int allocASID();
+    memaddr freeASID(int ASID);
 #endif
\ No newline at end of file
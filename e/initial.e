@@ -9,15 +9,23 @@
     extern int processCount;
     /* the soft blocked count */
     extern int softBlockedCount;
-    /* the current process */
-    extern pcb_PTR currentProcess;
-    /* the queue of ready processes */
-    extern pcb_PTR readyQueue;
+    /* the processors; the current process and its timing are kept 
+    per processor, for the processor running the code */
+    extern percpu_t cpus[NCPUS];
+    extern unsigned int onlineCpus;
+    #define currentProcess (cpus[getPRID()].c_current)
+    #define startTOD (cpus[getPRID()].c_startTOD)
+    #define currentTOD (cpus[getPRID()].c_currentTOD)
     /* semaphore list */
     extern int semdTable[MAXSEMALLOC];
-    /* clock */
-    extern cpu_t startTOD;
-/* * */
-    extern cpu_t currentTOD;
+    /* latched device status */
+    extern unsigned int deviceStatus[MAXSEMALLOC];
+    /* the process lock and TLB consistency across processors */
+    extern void lockProcesses();
+    extern void unlockProcesses();
+    extern void reapCurrent();
+    extern void tlbShootdown(int asid, unsigned int entryHI);
+    extern void tlbRetireASID(int asid);
+    extern void cpuEnter();
 
 #endif
@@ -4,4 +4,6 @@
 #define INT
     extern void copyState(state_PTR from, state_PTR to);
     extern void interruptHandler();
+    extern void initRouting();
+    extern void steerDevice(int semIndex);
 #endif
\ No newline at end of file
@@ -2,5 +2,25 @@
 #include "../h/types.h"
 #ifndef PAGER
 #define PAGER
+    extern swapPool_t* pool;
+    extern int swapPoolSize;
+    extern memaddr swapPoolStart;
+    extern int freeFrames;
+    extern int residentQuota;
     void invalidateEntry(int frameNumber);
-#endif
\ No newline at end of file
+    void initSwapPool();
+    void pager();
+    void releaseUProcLoad(int ASID);
+    int findImage(unsigned int fingerprint, int textPages, int* tapeOf);
+    void dropImage(int image);
+    int registerImage(unsigned int fingerprint, int textPages, int tape);
+    void tapeSeek(int tape, int block, memaddr buffer);
+    void releaseImage(int ASID);
+    void unshareFrame(int frameNumber);
+    void settleFrames(int ASID);
+    int forkFrames(int parent, int child);
+    void releaseCowShares(int ASID);
+    int cowShared(int frameNumber);
+    void resizeResidentQuota(int uprocs);
+    void progTrapHandler();
+#endif
@@ -14,12 +14,16 @@
 extern void freePcb (pcb_PTR p);
 extern pcb_PTR allocPcb ();
 extern void initPcbs ();
+extern void setPcbLimit (int limit);
+extern trapvec_t *attachTraps (pcb_PTR p);
+extern pcb_PTR pidLookup (int pid);
 
 extern pcb_PTR mkEmptyProcQ ();
 extern int emptyProcQ (pcb_PTR tp);
 extern void insertProcQ (pcb_PTR *tp, pcb_PTR p);
 extern pcb_PTR removeProcQ (pcb_PTR *tp);
 extern pcb_PTR outProcQ (pcb_PTR *tp, pcb_PTR p);
+extern void unlinkProcQ (pcb_PTR *tp, pcb_PTR p);
 extern pcb_PTR headProcQ (pcb_PTR tp);
 
 extern int emptyChild (pcb_PTR p);
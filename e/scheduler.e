@@ -3,6 +3,13 @@
 #ifndef SCHED
 #define SCHED
     extern void invokeScheduler();
-    extern stopTOD;
-    extern startTOD;
+    extern void makeReady(pcb_PTR p);
+    extern int unready(pcb_PTR p);
+    extern void boostProcess(pcb_PTR p, int priority);
+    extern void chargeCurrent();
+    extern void serviceShootdown();
+    extern unsigned int asidCpus[MAXASID];
+    extern spinlock_t shootdownLock;
+    extern unsigned int shootdownPending;
+    extern spinlock_t processLock;
 #endif
\ No newline at end of file
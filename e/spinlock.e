@@ -0,0 +1,21 @@
+#ifndef SPINLOCK
+#define SPINLOCK
+
+/************************ SPINLOCK.E ***************************
+*
+*  The externals declaration file for the Spinlock
+*    Module.
+*
+*/
+
+#include "../h/types.h"
+
+extern void spinLock (spinlock_t *lock);
+extern void spinUnlock (spinlock_t *lock);
+extern void atomicAdd (int *word, int delta);
+extern void atomicSet (unsigned int *word, unsigned int bits);
+extern void atomicClear (unsigned int *word, unsigned int bits);
+
+/***************************************************************/
+
+#endif
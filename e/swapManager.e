@@ -0,0 +1,12 @@
+#include "../h/const.h"
+#include "../h/types.h"
+#ifndef SWAPMANAGER
+#define SWAPMANAGER
+    extern void initSwapSpace();
+    extern int reserveSwapGroup(int ASID);
+    extern void releaseSwapGroup(int ASID);
+    extern void swapLocate(int ASID, int segmentNumber, int pageNumber, int diskInformation[]);
+    extern int isBacked(int ASID, int segmentNumber, int pageNumber);
+    extern void markBacked(int ASID, int segmentNumber, int pageNumber);
+    extern int swapUtilization(int* used, int* reserved, int* total);
+#endif
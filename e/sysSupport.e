@@ -2,9 +2,14 @@
 #include "../h/types.h"
 #ifndef SYSSUPPORT
 #define SYSSUPPORT
-    void diskOperation(int diskInformation[], int *semaphore, device_PTR diskDevice);
+    void diskOperation(int diskInformation[], mutex_PTR semaphore, device_PTR diskDevice);
+    void tapeOperation(int tapeNumber, int command, memaddr buffer);
+    void tapeStart(int tapeNumber, int command, memaddr buffer);
+    void tapeWait(int tapeNumber);
     void mutex(int flag, int *semaphore);
+    void ownMutex(int flag, mutex_PTR semaphore);
     void terminateUProcess();
+    void uSyscallHandler();
     void enableInterrupts();
     void disableInterrupts();
 #endif
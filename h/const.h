@@ -115,6 +115,93 @@
 #define GETCPUTIME 6
 #define WAITFORCLOCK 7
 #define WAITFORIODEVICE 8
+/* process id syscalls, numbered past the support level ones */
+#define GETPID 20
+#define TERMINATEPID 21
+#define SIGNALPID 22
+/* processor affinity syscalls */
+#define SETAFFINITY 23
+#define GETAFFINITY 24
+/* priority syscall */
+#define SETPRIORITY 25
+/* real-time syscalls */
+#define SETREALTIME 26
+#define GETMISSES 27
+/* mutex syscalls, with priority inheritance */
+#define LOCKMUTEX 28
+#define UNLOCKMUTEX 29
+
+/* symmetric multiprocessing: the processors of the machine configuration and
+the exception areas of each one. processor 0 uses the ROM reserved page, the
+others the areas handed to INITCPU, laid out the same way. each processor has
+a nucleus stack page below RAMTOP: processor 0 at the top, then the
+TESTSTACKPAGES test() and the processes it creates carve their stacks out of,
+then the others */
+#define NCPUS 4
+#define TESTSTACKPAGES 8
+#define CPUAREAS 8
+#define CPUAREA(AREA) ((getPRID() == 0) ? ((state_PTR) (AREA)) : \
+    &(cpus[getPRID()].c_areas[((AREA) - INTRUPTOLDAREA) / sizeof(state_t)]))
+#define CPUSTACK(TOP, ID) (((ID) == 0) ? (TOP) : ((TOP) - (((ID) + TESTSTACKPAGES) * PAGESIZE)))
+#define NOLOCK 0
+/* a process that has not run on any processor yet */
+#define NOCPU -1
+/* priority levels: 0 is the highest. every run queue has a queue per level
+and a bitmap of the levels with a process ready. every AGINGPERIOD dispatches
+the oldest process of each level moves up one, but never more than AGINGLIMIT
+levels above its own priority */
+#define PRIOLEVELS 8
+#define DEFAULTPRIO 4
+#define AGINGPERIOD 8
+#define AGINGLIMIT 2
+/* the real-time class: periods and budgets are in microseconds, a period of
+at most MAXRTPERIOD. a process is admitted to a processor only if the sum of
+budget/period over the real-time processes there stays within RTUTILBOUND
+thousandths of it, which EDF can meet; the rest is kept for best effort */
+#define UTILSCALE 1000
+#define RTUTILBOUND 900
+#define MAXRTPERIOD 1000000
+/* priority inheritance: a process holding a mutex runs at the highest priority
+of the processes waiting on the mutexes it holds, if that is higher than its
+own, until it has released them all. a real-time waiter passes on level 0 */
+#define NOBOOST PRIOLEVELS
+#define EFFPRIO(P) (MIN((P)->p_priority, (P)->p_boost))
+/* the active semaphore list is hashed on the semaphore address into buckets,
+each with a lock of its own. there are more buckets than device semaphores,
+so every device semaphore, being a word of semdTable, has a bucket (and a
+lock) to itself */
+#define ASLBUCKETS 64
+#define ASLBUCKET(SEMADD) ((((memaddr) (SEMADD)) / WORDLEN) % ASLBUCKETS)
+/* inter-processor interrupts, on line 0: a processor sends a message by writing
+the recipients (a bit per processor) and the message to its outbox, and a
+recipient acknowledges it by writing its inbox */
+#define IPIINBOX ((memaddr*) 0x10000400)
+#define IPIOUTBOX ((memaddr*) 0x10000404)
+#define IPIRECIPSHIFT 8
+#define IPISHOOTDOWN 1
+/* TLB shootdowns: to every processor rather than the ones that ran an ASID,
+and of the whole TLB rather than one entry */
+#define ALLCPUS ((1 << NCPUS) - 1)
+#define ALLASIDS -1
+#define ALLPAGES 0xFFFFFFFF
+/* the index register after a probe that found nothing */
+#define PROBEFAIL 0x80000000
+/* the interrupt routing table: a word per device of interrupt lines 2-7 that
+names the processor its interrupts are delivered to (static routing). the
+interval timer is line 2, device 0; the devices with semaphores are routed
+per (line, device) entry, both halves of a terminal sharing one */
+#define IRTBASE 0x10000300
+#define IRTENTRY(LINE, DEV) ((memaddr*) (IRTBASE + (((((LINE) - 2) * DEVPERINT) + (DEV)) * WORDLEN)))
+#define INTERVALLINE 2
+#define DEVENTRIES (SEMDEVICE * DEVPERINT)
+#define DEVENTRY(SEMINDEX) ((MIN((SEMINDEX) / DEVPERINT, TERMINT - NOSEM) * DEVPERINT) + ((SEMINDEX) % DEVPERINT))
+
+/* process ids: the low bits pick the slot of the pid table, the high
+bits are the slot's generation, so a stale pid never matches */
+#define PIDSLOTBITS 8
+#define PIDSLOTS (1 << PIDSLOTBITS)
+#define PIDGENMASK 0x007FFFFF
+#define NOPID -1
 
 /* utility constants */
 #define	TRUE 1
@@ -128,8 +215,14 @@
 #define FAILURE -1
 
 /* page tables and virtual memory */
-#define MAXUPROC 8
-#define SWAPSIZE 3 * MAXUPROC
+/* ASID 0 is the kernel's, every other ASID can be a uproc */
+#define MAXASID 64
+#define MAXUPROC (MAXASID - 1)
+#define NOASID -1
+/* the uprocs started from the tapes at boot */
+#define TAPEUPROCS DEVPERINT
+/* the smallest swap pool the support level will boot with */
+#define MINSWAPSIZE (3 * TAPEUPROCS)
 
 /* segment */
 #define SEGSTART 0x20000500
@@ -152,6 +245,7 @@
 #define SEGMENTMASK 30
 
 /* causes */
+#define TLBMOD 1
 #define TLBL 2
 #define TLBS 3
 
@@ -170,8 +264,57 @@
 #define PGTBLHEADERWORD 24
 
 /* virtual memory & swap pool */
-#define SWAPPOOLSIZE 
+/* the kernel image is loaded just above the ROM reserved page, with its
+a.out header kept at the start of the text area */
+#define KERNELSTART (ROMPAGESTART + PAGESIZE)
+#define AOUTDATAVADDR 6
+#define AOUTDATAMEMSZ 7
+#define AOUTDATAOFFSET 8
+#define AOUTDATAFILESZ 9
+/* pages below RAMTOP holding the nucleus stacks, one per processor, and test()'s */
+#define KERNELSTACKPAGES (NCPUS + TESTSTACKPAGES)
+/* resident set quotas and load control */
+#define MINRESIDENT 3
+/* the page fault frequency window - one pseudo-clock tick */
+#define PFFWINDOW 100000
+/* faults per window across all uprocs that signal thrashing */
+#define THRASHFAULTS (4 * TAPEUPROCS)
+/* pseudo-clock ticks a suspended uproc sits out */
+#define SUSPENDTICKS 5
+/* swap space slots on the backing store */
+#define MAXSWAPSLOTS 4096
+#define SWAPMAPWORDS (MAXSWAPSLOTS / 32)
+#define NOSLOT -1
+/* disk geometry as reported in DATA1 */
+#define GEOCYLSHIFT 16
+#define GEOHEADSHIFT 8
+/* round an address up to the next page boundary */
+#define PAGEROUND(A) ((((memaddr) (A)) + PAGESIZE - 1) & ~(PAGESIZE - 1))
+/* the kernel heap: a buddy system over the pages above the kernel image.
+blocks are 2^order pages, and the heap takes a share of the free RAM */
+#define HEAPORDERS 9
+#define HEAPMAXPAGES 256
+#define HEAPSHARE 2
+#define FREEBLOCK 0x80
+/* the address of no block, as the heap returns it (the memaddr twin of NULL) */
+#define NOPAGE 0xFFFFFFFF
+/* every processor keeps a magazine of free objects in front of each slab
+cache; an empty one is refilled, and a full one drained, a batch at a time */
+#define MAGSIZE 8
+#define MAGBATCH 4
+/* shared text pages: the owner of a shared frame and the image fingerprint hash */
+#define SHAREDFRAME 0
+/* copy on write frames record their sharers in a set of ASIDs */
+#define ASIDWORDS (MAXASID / 32)
+#define ASIDIN(S, A) ((((S).bits[(A) / 32]) & (1 << ((A) % 32))) != 0)
+#define ASIDADD(S, A) ((S).bits[(A) / 32] |= (1 << ((A) % 32)))
+#define ASIDDEL(S, A) ((S).bits[(A) / 32] &= ~(1 << ((A) % 32)))
+#define NOIMAGE -1
+#define FNVOFFSET 0x811C9DC5
+#define FNVPRIME 0x01000193
 #define KUSEGPTESIZE 32
+/* the bit tracking page P in a backing-store bitmap */
+#define PAGEBIT(P) (1 << (P))
 #define KSEGOSPTESIZE 64
 
 /* for uproc init */
@@ -202,7 +345,16 @@
 #define TAPEDEV (((TAPEINT - NOSEM) * DEVREGSIZE * DEVPERINT) + INTDEVREG)
 #define DISKDEV (((DISKINT - NOSEM) * DEVREGSIZE * DEVPERINT) + INTDEVREG)
 #define PRINTERDEV (INTDEVREG + (PRNTINT - NOSEM) * DEVREGSIZE * DEVPERINT)
-#define BUFFER (KSEGOSARA - (DISKCOUNT * PAGESIZE))
+/* each uproc is handed heap pages when its ASID is allocated: a tape
+buffer page, and a block of two pages for its TLB and PGM/SYS stacks */
+#define STACKORDER 1
+#define TAPEBUFFER(ASID) (uProcesses[(ASID) - 1].Tp_buffer)
+#define UPROCSTACK(ASID, TYPE) (uProcesses[(ASID) - 1].Tp_stacks + (((TYPE) + 1) * PAGESIZE))
+/* a uproc without a terminal or printer */
+#define NODEVICE -1
+/* the mutual exclusion semaphores of the terminals */
+#define TERMRECVSEM(DEV) (((TERMINT - NOSEM) * DEVPERINT) + (DEV))
+#define TERMTRANSMSEM(DEV) (((TERMINT - NOSEM + 1) * DEVPERINT) + (DEV))
 
 
 /* disk parameters */
@@ -239,6 +391,10 @@
 #define READBLK 3
 #define WRITEBLK 4
 
+/* tape devices commands */
+#define SKIPBLK 2
+#define BACKBLK 4
+
 /* device common COMMAND codes */
 #define RESET 0
 #define ACK	1
@@ -267,6 +423,9 @@
 #define GET_TOD 17
 #define GETTIME 17
 #define TERMINATE 18
+#define FORK 19
+/* past the nucleus' own syscalls, which a uproc cannot make */
+#define GET_SWAP 30
 
 /* operations */    
 #define	MIN(A,B)	((A) < (B) ? A : B)
@@ -10,6 +10,8 @@
 
 typedef signed int cpu_t;
 typedef unsigned int memaddr;
+/* a spinlock: NOLOCK, or one more than the id of the processor holding it */
+typedef unsigned int spinlock_t;
 
 /* device type */
 typedef struct {
@@ -91,7 +93,26 @@ typedef struct state_t {
 #define s_LO	s_reg[30]
 
 
-/* process table entry type */
+/* the exception vectors of a process, attached the first time it
+issues a SYS5, since most processes never do */
+typedef struct trapvec_t {
+	/* old syscall */
+	state_t* oldSys;
+	/* new sys */
+	state_t* newSys;
+	/* old program trap */
+	state_t* oldPgm;
+	/* new program trap */
+	state_t* newPgm;
+	/* old tlb */
+	state_t* oldTlb;
+	/* new tlb */
+	state_t* newTlb;
+} trapvec_t;
+
+/* process table entry type; the fields the queue, tree and
+semaphore operations walk come first, so they share a cache line,
+and the processor state lives in a block of its own */
 typedef struct pcb_t {
 	/* queue relationship */
 	/* the next pcb_t */
@@ -106,27 +127,83 @@ typedef struct pcb_t {
 	struct pcb_t* p_nextSib;
 	/* the pcb_t previous sibiling */
 	struct pcb_t* p_prevSib;
-	/* processor state */
-    state_t p_state;
 	/* the semaphore address */
     int* p_semAdd;
-	/* old syscall */
-	state_t* oldSys;
-	/* new sys */
-	state_t* newSys;
-	/* old program trap */
-	state_t* oldPgm;
-	/* new program trap */
-	state_t* newPgm;
-	/* old tlb */
-	state_t* oldTlb;
-	/* new tlb */
-	state_t* newTlb;
+	/* the descriptor of that semaphore, so the pcb_t comes off it in constant time */
+	struct semd_t* p_semd;
 	/* start time of day */
 	cpu_t p_time; 
+	/* processor state */
+	state_t* p_state;
+	/* the exception vectors, NULL until SYS5 */
+	trapvec_t* p_traps;
+	/* the process id */
+	int p_pid;
+	/* the processor it last ran on, whose run queue it goes back to */
+	int p_cpu;
+	/* the processors it may run on, a bit per processor */
+	unsigned int p_affinity;
+	/* its priority, and the level it is queued at after aging */
+	int p_priority;
+	int p_level;
+	/* the priority it inherits from the waiters on the mutexes it holds 
+	(NOBOOST if none), how many mutexes it holds, and the mutexes, 
+	linked through m_next, so they are released if it dies */
+	int p_boost;
+	int p_mutexes;
+	struct mutex_t* p_held;
+	/* the real-time class: its period (0 if it is best effort) and budget, 
+	the end of its current period, the budget used in it and the deadlines missed */
+	cpu_t p_period;
+	cpu_t p_budget;
+	cpu_t p_deadline;
+	cpu_t p_runtime;
+	int p_misses;
+	/* the utilization its processor admitted it with, until it is given 
+	back (0 if none) */
+	int p_rtUtil;
+	/* is it on a run queue? */
+	int p_ready;
+	/* terminated while running on another processor, which reaps it */
+	int p_doomed;
+	/* a kernel heap block the process runs on, which the support level 
+	hands over before it terminates; freed with the pcb_t (NOPAGE if none) */
+	memaddr p_heapBlock;
 	/* * */
 }  pcb_t, *pcb_PTR;
 
+/* what the nucleus keeps for each processor */
+typedef struct percpu_t {
+	/* the process running on the processor */
+	pcb_t* c_current;
+	/* the run queue of the processor: a queue per priority level, the 
+	levels that are not empty, how many are on them, the real-time 
+	processes, and its lock */
+	pcb_t* c_readyQueues[PRIOLEVELS];
+	unsigned int c_readyMap;
+	int c_readyCount;
+	pcb_t* c_rtQueue;
+	spinlock_t c_lock;
+	/* the real-time utilization admitted here, in thousandths */
+	int c_rtUtil;
+	/* the dispatches made, for aging */
+	unsigned int c_dispatches;
+	/* when it was dispatched, and the clock as the scheduler read it */
+	cpu_t c_startTOD;
+	cpu_t c_currentTOD;
+	/* the old and new exception areas of a secondary processor */
+	state_t c_areas[CPUAREAS];
+} percpu_t;
+
+/* a semaphore used as a mutex: its value, and the pid of the process 
+holding it (NOPID if none), which the nucleus keeps for priority inheritance, 
+and the next mutex the holder holds */
+typedef struct mutex_t {
+	int m_value;
+	int m_owner;
+	struct mutex_t* m_next;
+} mutex_t, *mutex_PTR;
+
 /* semaphore table entry type */
 typedef struct semd_t {
 	/* the next semaphore address */
@@ -140,6 +217,45 @@ typedef struct semd_t {
 	/* * */
 } semd_t, *semd_PTR;
 
+/* a free block of the kernel heap, linked through its first page */
+typedef struct heapBlock_t {
+	struct heapBlock_t* b_next;
+	struct heapBlock_t* b_prev;
+} heapBlock_t;
+
+/* a slab: one heap page cut into objects of a single size */
+typedef struct slab_t {
+	/* the next slab of the cache */
+	struct slab_t* sl_next;
+	/* the objects handed out from this slab */
+	int sl_inUse;
+	/* the free objects, linked through their first word */
+	memaddr sl_free;
+} slab_t;
+
+/* the free objects a processor keeps in front of a cache */
+typedef struct magazine_t {
+	int m_count;
+	memaddr m_objects[MAGSIZE];
+} magazine_t;
+
+/* a cache of objects of one size, grown a slab at a time */
+typedef struct cache_t {
+	/* the size of an object, rounded up to a word */
+	int c_size;
+	/* the most objects the cache may hand out */
+	int c_limit;
+	/* the objects handed out to callers */
+	int c_handed;
+	/* the objects out of the slabs, magazines included */
+	int c_inUse;
+	/* the slabs of the cache, and the lock guarding them */
+	slab_t* c_slabs;
+	spinlock_t c_lock;
+	/* the magazine of each processor */
+	magazine_t c_mags[NCPUS];
+} cache_t;
+
 /* page table entry type */
 typedef struct pteEntry_t {
 	unsigned int entryHI;
@@ -165,18 +281,72 @@ typedef struct segt_t {
 	pteOS_t* kSegOS;
 } segt_t, *segt_PTR;
 
+/* a set of ASIDs, one bit each */
+typedef struct asidset_t {
+	unsigned int bits[ASIDWORDS];
+} asidset_t;
+
 /* type for the swap poo; */
 typedef struct swapPool_t {
 	int ASID;
 	int segmentNumber;
 	int pageNumber;
 	pteEntry_t* pageTableEntry;
+	/* the image of a shared text page and the uprocs mapping it */
+	int image;
+	int refCount;
+	/* the uprocs sharing a copy on write page, empty for a private frame */
+	asidset_t sharers;
+	/* set while the frame is being written back and filled */
+	int busy;
+	/* the page being written back out of a busy frame */
+	int victimASID;
+	asidset_t victimSharers;
+	int victimSegment;
+	int victimPage;
+	/* uprocs waiting on the frame to settle */
+	int waiters;
+	int frameSem;
 } swapPool_t;
 
+/* a uproc image whose read-only text pages are shared */
+typedef struct image_t {
+	/* hash of the text pages, 0 if the slot is free */
+	unsigned int fingerprint;
+	int textPages;
+	/* a tape the text can be read from, to compare it with another's */
+	int tape;
+	/* the uprocs running the image */
+	int users;
+	/* the frame holding each text page, -1 if not resident */
+	int frames[KUSEGPTESIZE];
+} image_t;
+
 /* tproc type */
 typedef struct Tproc_t {
 	int Tp_sem;
+	/* the first backing-store slot of the uproc's swap group */
 	int diskAddr;
+	/* bit i is set once page i has a copy on the backing store */
+	unsigned int Tp_backed;
+	/* the support pages from the kernel heap: tape buffer and trap handler stacks */
+	memaddr Tp_buffer;
+	memaddr Tp_stacks;
+	/* the terminal and printer the uproc's I/O syscalls use */
+	int Tp_terminal;
+	int Tp_printer;
+	/* the tape the image pages come from and the blocks of the a.out image on it */
+	int Tp_tape;
+	int Tp_tapeBlocks;
+	/* the image the uproc's text pages are shared with */
+	int Tp_image;
+	/* frames currently held and the local replacement hand */
+	int Tp_resident;
+	int Tp_hand;
+	/* page faults taken in the current load control window */
+	int Tp_faults;
+	/* set while the load controller holds the uproc back */
+	int Tp_suspended;
 	pte_t Tp_pte;
 	state_t Tnew_trap[3];
 	state_t Told_trap[3];
@@ -1,8 +1,10 @@
 /*************************************************** asl.c **************************************************************
 	asl.c implements a semaphore list - an important OS concept; here, the asl will be seen as an integer value and
 	will keep addresses of Semaphore Descriptors, henceforth known as semd_t; much like in the pcb.c, the asl will keep an
-	asl free list with MAXPROC free semd_t; this class will encapsulate the functionality needed too perform operations on
-	the semd_t
+	slab cache of semd_t on the kernel heap, MAXPROC of them by default; this class will encapsulate the functionality needed too perform operations on
+	the semd_t. So that the processors can work on unrelated semaphores at once, the asl is hashed on the semaphore
+	address into ASLBUCKETS sorted lists, each with its own dummy nodes and its own lock; a processor holds the lock
+	of a semaphore's bucket while it changes the semaphore and the processes blocked on it
 
 	This module contributes function definitions and a few sample fucntion implementations to the contributors put forth by
 	the Kaya OS project
@@ -16,19 +18,23 @@
 #include "../h/types.h"
 /* e files to include */
 #include "../e/pcb.e"
+#include "../e/heap.e"
+#include "../e/spinlock.e"
 
 /* globals */
-/* pointer to the head free list of semd_t */
-static semd_PTR semdFl_h;
-/* pointer to the head of the active semd_t list - the asl */
-static semd_PTR semdAsl_h;
+/* the semd_t cache on the kernel heap */
+static cache_t semdCache;
+/* pointers to the heads of the active semd_t lists - the asl
+buckets - and the lock of each bucket */
+static semd_PTR semdAsl_h[ASLBUCKETS];
+static spinlock_t aslLocks[ASLBUCKETS];
 
 /************************************************************************************************************************/
 /******************************************** HELPER FUNCTIONS  *********************************************************/
 /************************************************************************************************************************/
 
 /*
-* Function: searches the semd_t asl list for
+* Function: searches the semd_t asl bucket of
 * the specified semd_t address passed in as an
 * argument to the function; since there are two
 * dummy semd_t on the list, there are no erronous
@@ -36,7 +42,7 @@ static semd_PTR semdAsl_h;
 */
 static semd_PTR findSemd(int* semAdd) {
 	/* retrieve the head of the list */
-	semd_PTR currentSemd = semdAsl_h;
+	semd_PTR currentSemd = semdAsl_h[ASLBUCKET(semAdd)];
 	/* if the semaphore address is null, set the 
 	address to be the MAXINT - so that the loop may iterate 
 	correctly and does not return null */
@@ -69,31 +75,11 @@ static semd_PTR findSemd(int* semAdd) {
 
 
 /*
-* Function: takes a semd_t and points it onto
-* the semd_t free list; if there is nothing on
-* the semd_t free list, a free list is "created"
-* by making the newly added semd_t next semd_t
-* to be null; if its not empty
+* Function: gives a semd_t that is no longer
+* active back to the semd_t cache
 */
 static void freeSemd(semd_PTR s) {
-	/* check if the free list is null - the first case in 
-	the options */
-	if(semdFl_h == NULL) {
-		/* since there is no semd_t free list make the
-		supplied argument the head of list */
-		semdFl_h = s;
-		/* if the semd_t free list is empty,
-		then it has no next semd_t once the
-		new one is added; set this value */
-		semdFl_h->s_next = NULL;
-	} else {
-		/* the semd_t free list is not empty, so simply
-		just asign the semd_t argument's next field equal
-		to the head of the semd_t free list */
-		s->s_next = semdFl_h;
-		/* asign then next semd_t to be the head */
-		semdFl_h = s;
-	}
+	cacheFree(&(semdCache), (memaddr) s);
 }
 
 /*
@@ -116,22 +102,21 @@ static semd_PTR cleanSemd(semd_PTR s) {
 
 /*
 *	Function: allocates a semd_t from the semd_t
-* free list and returns a pointer to it;
-* should the send_t free list head is null,
-* then there are no free semd_t to allocate
+* cache and returns a pointer to it; should the
+* cache be at its limit or the kernel heap be
+* full, then there are no free semd_t to allocate
 */
 static semd_PTR allocSemd() {
 	/* check if there are free semd_t on the
 	free list by checking for null */
-	semd_PTR openSemd = semdFl_h;
-	/* if the free list head is null, simply return null - 
+	memaddr block = cacheAlloc(&(semdCache));
+	semd_PTR openSemd;
+	/* if the cache is at its limit, simply return null - 
 	where are done here */
-	if(semdFl_h == NULL) {
+	if(block == NOPAGE) {
 		return NULL;
 	}
-	semdFl_h = semdFl_h->s_next;
-	/* adjust the pointer */
-	openSemd = cleanSemd(openSemd);
+	openSemd = cleanSemd((semd_PTR) block);
 	return openSemd;
 }
 
@@ -144,49 +129,75 @@ static semd_PTR allocSemd() {
 * Function: the first and perhaps most important
 * stored procedure - the allocation of the
 * active semaphore list asl of type semd_t;
-* here, the semd_t free list is allocated to be
-* of size MAXPROC, where MAXPROC = 20;
-* IMPORTANT! this implementation of the
-* semd_t free list uses 2 DUMMY nodes as to avoid
-* error-prone exit conditions - which will be referenced
-* further on in the documentation; thus, the semd_t
-* free list will have MAXPROC + 2 dummy nodes to account
-* for the space necessary to house enough semd_t on the
-* free list
+* here, the semd_t cache is set up on the kernel
+* heap, with MAXPROC semd_t active at once by
+* default; IMPORTANT! this implementation of the
+* asl uses 2 DUMMY nodes on every bucket as to
+* avoid error-prone exit conditions - which will
+* be referenced further on in the documentation;
+* they come from the cache as well, so its limit
+* is two per bucket more than the number of
+* active semaphores
 */
 void initASL() {
-	static semd_t semdTable[MAXPROC + 2];
+	semd_PTR maxSemd;
+	semd_PTR minSemd;
 	int i;
-	semdAsl_h = NULL;
-	semdFl_h = NULL;
-	 /* insert MAXPROC nodes onto the free list */
-	for(i = 0; i < MAXPROC; ++i){
-		freeSemd(&(semdTable[i]));
-	}
+	initCache(&(semdCache), sizeof(semd_t), MAXPROC + (2 * ASLBUCKETS));
 	/* here, the semd_t edge (dummy) nodes to ensure
 	that no address is greather than or less than the
-	specified address values; this makes a call to the
-	mkEdgeSemd function - which takes the address value as
-	the argument; the minium will be 0 and the maxiumum
-	will be the largest possible unsigned interger value -
-	to ensure when travsering the semd_t asl, will never
-	return null - indicating the edge of the list */
-	/* max node */
-	semdAsl_h = &(semdTable[MAXPROC + 1]);
-	/* start with the max*/
-	/* clean the node */
-	semdAsl_h -> s_next = NULL;
-	semdAsl_h -> s_procQ = mkEmptyProcQ();
-	/* set the address to be MAXINT */
-	semdAsl_h -> s_semAdd = (int*) MAXINT;
-	/* end with the ma=inx*/
-	/* clean the node */
-	(semdTable[MAXPROC]).s_next = semdAsl_h;
-	/* clean the node */
-	semdAsl_h = &(semdTable[MAXPROC]);
-	semdAsl_h -> s_procQ = mkEmptyProcQ();
-	/* set the node to be 0 */
-	semdAsl_h -> s_semAdd = 0;
+	specified address values; the minium will be 0 and
+	the maxiumum will be the largest possible unsigned
+	interger value - to ensure when travsering the semd_t
+	asl, will never return null - indicating the edge of
+	the list */
+	for(i = 0; i < ASLBUCKETS; i++) {
+		/* max node */
+		maxSemd = (semd_PTR) cacheAlloc(&(semdCache));
+		maxSemd -> s_next = NULL;
+		maxSemd -> s_prev = NULL;
+		maxSemd -> s_procQ = mkEmptyProcQ();
+		/* set the address to be MAXINT */
+		maxSemd -> s_semAdd = (int*) MAXINT;
+		/* min node */
+		minSemd = (semd_PTR) cacheAlloc(&(semdCache));
+		minSemd -> s_next = maxSemd;
+		minSemd -> s_prev = NULL;
+		maxSemd -> s_prev = minSemd;
+		minSemd -> s_procQ = mkEmptyProcQ();
+		/* set the node to be 0 */
+		minSemd -> s_semAdd = 0;
+		semdAsl_h[i] = minSemd;
+		aslLocks[i] = NOLOCK;
+	}
+}
+
+/*
+* Function: changes the number of semaphores
+* that may be active at once; the dummy
+* nodes are not counted
+*/
+void setSemdLimit(int limit) {
+	setCacheLimit(&(semdCache), limit + (2 * ASLBUCKETS));
+}
+
+/*
+* Function: takes the lock of the asl bucket
+* the semaphore hashes to; the semaphore and
+* its blocked processes may then be changed,
+* on this processor alone. the asl operations
+* on the semaphore expect the caller to hold it
+*/
+void lockSemaphore(int* semAdd) {
+	spinLock(&(aslLocks[ASLBUCKET(semAdd)]));
+}
+
+/*
+* Function: lets go of the lock of the asl
+* bucket the semaphore hashes to
+*/
+void unlockSemaphore(int* semAdd) {
+	spinUnlock(&(aslLocks[ASLBUCKET(semAdd)]));
 }
 
 
@@ -214,6 +225,7 @@ int insertBlocked(int* semAdd, pcb_PTR p) {
 		/* asign the s_semAdd - per the function
 		implementation definition */
 		p->p_semAdd = semAdd;
+		p->p_semd = locSemd->s_next;
 		/* insert the formatted pcb_t into the process
 		queue; since our work for this was completed in
 		pcb.c, simply utilize the work of this function
@@ -246,6 +258,8 @@ int insertBlocked(int* semAdd, pcb_PTR p) {
 	/* arrange the new semd_t so that is in the appropriate place in
 	the semd_t free list */
 	openSemd->s_next = locSemd->s_next;
+	openSemd->s_prev = locSemd;
+	locSemd->s_next->s_prev = openSemd;
 	locSemd->s_next = openSemd;
 	/* pointers rearranged;
 	asign its necessary fields to function */
@@ -261,6 +275,7 @@ int insertBlocked(int* semAdd, pcb_PTR p) {
 	openSemd->s_semAdd = semAdd;
 	/* give the pcb_t its corresponding addresse */
 	p->p_semAdd = semAdd;
+	p->p_semd = openSemd;
 	/* the function was able to succesfully allocate a new
 	semd_t and asign the proccess queue in the field of the
 	pcb_t - signify this successful operation */
@@ -301,12 +316,14 @@ pcb_PTR removeBlocked(int* semAdd) {
 			a temporary semd_t to assist in this process */
 			semd_PTR headSemd = locSemd->s_next;
 			locSemd->s_next = headSemd->s_next;
+			headSemd->s_next->s_prev = locSemd;
 			/* the semd_t is cleaned */
 			/* free it up */
 			freeSemd(headSemd);
 		}
 		/* no longer has a semd_t address */
 		headPcb->p_semAdd = NULL;
+		headPcb->p_semd = NULL;
 		/* return the head */
 		return headPcb;
 	}
@@ -316,46 +333,33 @@ pcb_PTR removeBlocked(int* semAdd) {
 
 /*
 * Function: remove the pcb_t passed in as the argument from
-* the semd_t that contains the specified pcb; if the pcb_t
-* does not appear in the process queue in the associated
-* semd_t, return null
+* the semd_t that contains the specified pcb, in constant time;
+* if the pcb_t is not blocked on a semaphore, return null
 */
 pcb_PTR outBlocked(pcb_PTR p) {
-	/* find the location of the semaphore */
-	semd_PTR locSemd = findSemd(p->p_semAdd);
-	/* seach for a winner; this has to sub-cases;
-	if the semd_d does not exist, it cannot have a
-	returning pcb; if the removed pcb_t was the head -
-	that is the LAST pcb_t, then the semaphore associacted
-	must be returned to the free list; again, s_next is called
-	by the implementation definition of findSemd */
-	if((locSemd->s_next->s_semAdd) == (p->p_semAdd)) {
-		/* winner - we found our semd_t */
-		pcb_PTR rmvdPcb = outProcQ(&(locSemd->s_next->s_procQ), p);
-		/* now check if the newly removed pcb_t is causing the
-		semd_t to be free - so it can be re allocated to the
-		free list of semd_t */
-		if(emptyProcQ(locSemd->s_next->s_procQ)) {
-			/* the semaphore is now free - time to allocate it
-			back - we like to share */
-			semd_PTR openSemd = locSemd->s_next;
-			/* rearange the order of the semd_t free list by shifting
-			around the pointers that keep the list in order - a
-			very important step */
-			locSemd->s_next = locSemd->s_next->s_next;
-			/* free up the unused semd_t */
-			freeSemd(openSemd);
-		}
-		/* now that the semd_t is free on the list, the last importamt step is
-		to disassociate that pcb_t with a semd_t. this is a simple manipulation of
-		the struct fields */
-		rmvdPcb->p_semAdd = NULL;
-		return rmvdPcb;
-		/* return this cleaned pcb_t */
+	/* the pcb_t knows its semd_t, so neither the asl
+	nor the process queue has to be searched */
+	semd_PTR openSemd = p->p_semd;
+	if(openSemd == NULL) {
+		/* error condition: there is no associated sempaphore desciptior */
+		return NULL;
 	}
-	/* error condition: there is no associated sempaphore desciptior
-	with the given address */
-	return NULL;
+	unlinkProcQ(&(openSemd->s_procQ), p);
+	/* now check if the newly removed pcb_t is causing the
+	semd_t to be free - so it can be given back to the
+	semd_t cache; the asl is doubly linked, so it unlinks
+	itself - a very important step */
+	if(emptyProcQ(openSemd->s_procQ)) {
+		openSemd->s_prev->s_next = openSemd->s_next;
+		openSemd->s_next->s_prev = openSemd->s_prev;
+		freeSemd(openSemd);
+	}
+	/* now that the semd_t is free on the list, the last importamt step is
+	to disassociate that pcb_t with a semd_t. this is a simple manipulation of
+	the struct fields */
+	p->p_semAdd = NULL;
+	p->p_semd = NULL;
+	return p;
 }
 /*
 * Function: returns a pointer to the pcb_t
@@ -0,0 +1,402 @@
+/*************************************************** heap.c *************************************************************
+	heap.c is the kernel heap: the memory the kernel tables are allocated from at run time, rather than being fixed
+	arrays sized by compile time constants. The heap covers the pages between the end of the kernel image and the
+	swap pool, and hands them out with a buddy system: every block is 2^order pages and aligned to its own size, so a
+	freed block can find its buddy by flipping a single bit of its page index, and two free buddies merge back into
+	the block they were split from. On top of the page allocator sit the slab caches: a cache hands out objects of a
+	single size (pcb_t, semd_t, ...), cutting heap pages into objects as it grows, and gives a page back to the heap
+	once none of its objects are in use. Each cache has a limit on the objects it may hand out, which is how the
+	number of processes and semaphores is bounded now. The page allocator has a lock of its own, taken by every
+	allocation and free; the support level allocates pages too, so the lock is taken with interrupts off, as in the
+	nucleus, and a nucleus path on the same processor never spins on a holder it interrupted. So that the processors
+	do not fight over the slabs, each one keeps a small magazine of free objects in front of every cache: allocating
+	and freeing work on the magazine of the processor alone, and only an empty or full magazine goes to the slabs, a
+	batch of objects at a time, under the lock of the cache.
+
+	This module contributes function definitions and a few sample fucntion implementations to the contributors put forth by
+	the Kaya OS project
+
+***************************************************** heap.c ***********************************************************/
+
+
+/* h files to include */
+#include "../h/const.h"
+#include "../h/types.h"
+/* e files to include */
+#include "../e/heap.e"
+#include "../e/spinlock.e"
+/* include the µmps2 library */
+#include "/usr/local/include/umps2/umps/libumps.e"
+
+/* globals */
+/* the first page of the heap and the number of pages in it */
+static memaddr heapBase;
+static int heapPages;
+/* the free blocks of each order */
+static heapBlock_t* freeLists[HEAPORDERS];
+/* the order of the block starting at each page, FREEBLOCK is set while it is free */
+static unsigned char blockOrder[HEAPMAXPAGES];
+/* guards the free lists and the block orders */
+static spinlock_t heapLock;
+
+
+/************************************************************************************************************************/
+/******************************************** HELPER FUNCTIONS  *********************************************************/
+/************************************************************************************************************************/
+
+/* the address of a heap page */
+static memaddr pageAddress(int page) {
+	return heapBase + (page * PAGESIZE);
+}
+
+/* the heap page an address lies in */
+static int pageIndex(memaddr address) {
+	return (address - heapBase) / PAGESIZE;
+}
+
+/*
+* Function: puts the block starting at the
+* given page on the free list of its order
+* and marks it free
+*/
+static void pushBlock(int page, int order) {
+	heapBlock_t* block = (heapBlock_t*) pageAddress(page);
+	block->b_prev = NULL;
+	block->b_next = freeLists[order];
+	if(freeLists[order] != NULL) {
+		freeLists[order]->b_prev = block;
+	}
+	freeLists[order] = block;
+	blockOrder[page] = FREEBLOCK | order;
+}
+
+/*
+* Function: takes the block starting at the
+* given page off the free list of its order
+* and marks it in use
+*/
+static void unlinkBlock(int page, int order) {
+	heapBlock_t* block = (heapBlock_t*) pageAddress(page);
+	if(block->b_prev != NULL) {
+		block->b_prev->b_next = block->b_next;
+	} else {
+		freeLists[order] = block->b_next;
+	}
+	if(block->b_next != NULL) {
+		block->b_next->b_prev = block->b_prev;
+	}
+	blockOrder[page] = order;
+}
+
+/*
+* Function: cuts a fresh heap page into objects
+* of the cache's size and adds it to the cache;
+* the slab header sits at the start of the page.
+* Returns NULL if the heap is out of pages
+*/
+static slab_t* newSlab(cache_t* cache) {
+	memaddr page = allocPages(0);
+	memaddr object;
+	slab_t* slab;
+	if(page == NOPAGE) {
+		return NULL;
+	}
+	slab = (slab_t*) page;
+	slab->sl_inUse = 0;
+	slab->sl_free = NOPAGE;
+	/* link the objects from the top down, so the lowest comes out first */
+	for(object = page + PAGESIZE - cache->c_size; object >= (page + sizeof(slab_t)); object -= cache->c_size) {
+		*((memaddr*) object) = slab->sl_free;
+		slab->sl_free = object;
+	}
+	slab->sl_next = cache->c_slabs;
+	cache->c_slabs = slab;
+	return slab;
+}
+
+/*
+* Function: takes an empty slab out of its
+* cache and gives its page back to the heap
+*/
+static void releaseSlab(cache_t* cache, slab_t* slab) {
+	slab_t** link = &(cache->c_slabs);
+	while((*link) != slab) {
+		link = &((*link)->sl_next);
+	}
+	(*link) = slab->sl_next;
+	freePages((memaddr) slab);
+}
+
+
+/************************************************************************************************************************/
+/******************************************** BUDDY PAGE ALLOCATOR ******************************************************/
+/************************************************************************************************************************/
+
+/*
+* Function: sizes the heap and frees all of it;
+* the heap starts above the kernel image (or the
+* kSegOS area, whichever is higher) and takes
+* a share of the pages up to the nucleus stacks,
+* the rest is left for the swap pool. The pages
+* are put on the free lists as the largest aligned
+* blocks they make up. The pcb_t module brings the
+* heap up, as the first thing to be initialized
+*/
+void initHeap() {
+	/* the device register */
+	devregarea_PTR bus = (devregarea_PTR) RAMBASEADDR;
+	memaddr ramTop = bus->rambase + bus->ramsize;
+	/* the a.out header of the kernel tells us where its data and bss end */
+	memaddr* kernelHeader = (memaddr*) KERNELSTART;
+	memaddr kernelEnd = kernelHeader[AOUTDATAVADDR] + kernelHeader[AOUTDATAMEMSZ];
+	int page;
+	int order;
+	heapBase = MAX(PAGEROUND(kernelEnd), KSEGOSARA);
+	heapPages = ((ramTop - (KERNELSTACKPAGES * PAGESIZE) - heapBase) / PAGESIZE) / HEAPSHARE;
+	heapPages = MIN(heapPages, HEAPMAXPAGES);
+	heapLock = NOLOCK;
+	for(order = 0; order < HEAPORDERS; order++) {
+		freeLists[order] = NULL;
+	}
+	for(page = 0; page < HEAPMAXPAGES; page++) {
+		blockOrder[page] = 0;
+	}
+	page = 0;
+	while(page < heapPages) {
+		/* the largest block that is aligned here and fits */
+		order = HEAPORDERS - 1;
+		while(((page % (1 << order)) != 0) || ((page + (1 << order)) > heapPages)) {
+			order--;
+		}
+		pushBlock(page, order);
+		page = page + (1 << order);
+	}
+}
+
+/*
+* Function: the first address past the heap;
+* the swap pool starts here
+*/
+memaddr heapEnd() {
+	return pageAddress(heapPages);
+}
+
+/*
+* Function: allocates a block of 2^order pages;
+* the smallest free block that is large enough
+* is split in halves until it is the right size,
+* and the halves not used go on the free lists.
+* Returns NOPAGE if no block is large enough
+*/
+memaddr allocPages(int order) {
+	int found = order;
+	int page;
+	unsigned int status;
+	if((order < 0) || (order >= HEAPORDERS)) {
+		return NOPAGE;
+	}
+	status = getSTATUS();
+	setSTATUS(status & ~IEc);
+	spinLock(&heapLock);
+	while((found < HEAPORDERS) && (freeLists[found] == NULL)) {
+		found++;
+	}
+	if(found == HEAPORDERS) {
+		spinUnlock(&heapLock);
+		setSTATUS(status);
+		return NOPAGE;
+	}
+	page = pageIndex((memaddr) freeLists[found]);
+	unlinkBlock(page, found);
+	/* split off the upper halves */
+	while(found > order) {
+		found--;
+		pushBlock(page + (1 << found), found);
+	}
+	blockOrder[page] = order;
+	spinUnlock(&heapLock);
+	setSTATUS(status);
+	return pageAddress(page);
+}
+
+/*
+* Function: gives a block back to the heap;
+* while the buddy of the block is free and of
+* the same order the two are merged, then the
+* merged block goes on its free list
+*/
+void freePages(memaddr block) {
+	int page = pageIndex(block);
+	int order;
+	int buddy;
+	unsigned int status = getSTATUS();
+	setSTATUS(status & ~IEc);
+	spinLock(&heapLock);
+	order = blockOrder[page];
+	while(order < (HEAPORDERS - 1)) {
+		buddy = page ^ (1 << order);
+		if(((buddy + (1 << order)) > heapPages) || (blockOrder[buddy] != (FREEBLOCK | order))) {
+			break;
+		}
+		unlinkBlock(buddy, order);
+		page = MIN(page, buddy);
+		order++;
+	}
+	pushBlock(page, order);
+	spinUnlock(&heapLock);
+	setSTATUS(status);
+}
+
+
+/************************************************************************************************************************/
+/********************************************** SLAB CACHES *************************************************************/
+/************************************************************************************************************************/
+
+/*
+* Function: takes an object off the first slab
+* that has one free, growing the cache by a slab
+* when they are all full. The caller holds the
+* cache lock. Returns NOPAGE if the heap is full
+*/
+static memaddr slabAlloc(cache_t* cache) {
+	slab_t* slab = cache->c_slabs;
+	memaddr object;
+	while((slab != NULL) && (slab->sl_free == NOPAGE)) {
+		slab = slab->sl_next;
+	}
+	if(slab == NULL) {
+		slab = newSlab(cache);
+		if(slab == NULL) {
+			return NOPAGE;
+		}
+		/* the object does not fit in a page */
+		if(slab->sl_free == NOPAGE) {
+			releaseSlab(cache, slab);
+			return NOPAGE;
+		}
+	}
+	object = slab->sl_free;
+	slab->sl_free = *((memaddr*) object);
+	slab->sl_inUse++;
+	cache->c_inUse++;
+	return object;
+}
+
+/*
+* Function: puts an object back on its slab,
+* which is the page it lies in; once the slab
+* has no objects in use its page goes back to
+* the heap. The caller holds the cache lock
+*/
+static void slabFree(cache_t* cache, memaddr object) {
+	slab_t* slab = (slab_t*) (object & ~(PAGESIZE - 1));
+	*((memaddr*) object) = slab->sl_free;
+	slab->sl_free = object;
+	slab->sl_inUse--;
+	cache->c_inUse--;
+	if(slab->sl_inUse == 0) {
+		releaseSlab(cache, slab);
+	}
+}
+
+/*
+* Function: counts one more object as handed
+* out, unless the cache is at its limit; the
+* count is shared by the processors, so it is
+* changed with a compare and swap rather than
+* under the cache lock
+*/
+static int reserveObject(cache_t* cache) {
+	int handed;
+	do {
+		handed = cache->c_handed;
+		if(handed >= cache->c_limit) {
+			return FALSE;
+		}
+	} while(!CAS((unsigned int*) &(cache->c_handed), (unsigned int) handed, (unsigned int) (handed + 1)));
+	return TRUE;
+}
+
+/*
+* Function: sets up an empty cache for objects
+* of the given size, of which at most limit may
+* be handed out at once; no page is taken until
+* the first object is allocated
+*/
+void initCache(cache_t* cache, int size, int limit) {
+	int cpu;
+	cache->c_size = (size + WORDLEN - 1) & ~(WORDLEN - 1);
+	cache->c_limit = limit;
+	cache->c_handed = 0;
+	cache->c_inUse = 0;
+	cache->c_slabs = NULL;
+	cache->c_lock = NOLOCK;
+	for(cpu = 0; cpu < NCPUS; cpu++) {
+		cache->c_mags[cpu].m_count = 0;
+	}
+}
+
+/*
+* Function: changes the most objects the cache
+* may hand out; objects already handed out are
+* not affected
+*/
+void setCacheLimit(cache_t* cache, int limit) {
+	cache->c_limit = limit;
+}
+
+/*
+* Function: hands out an object from the
+* magazine of this processor, which only this
+* processor touches, so no lock is taken; an
+* empty magazine is first refilled with a batch
+* from the slabs, under the cache lock. Returns
+* NOPAGE if the cache is at its limit or the heap
+* is full
+*/
+memaddr cacheAlloc(cache_t* cache) {
+	magazine_t* mag = &(cache->c_mags[getPRID()]);
+	memaddr object;
+	if(!reserveObject(cache)) {
+		return NOPAGE;
+	}
+	if(mag->m_count == 0) {
+		spinLock(&(cache->c_lock));
+		while(mag->m_count < MAGBATCH) {
+			object = slabAlloc(cache);
+			if(object == NOPAGE) {
+				break;
+			}
+			mag->m_objects[mag->m_count] = object;
+			mag->m_count++;
+		}
+		spinUnlock(&(cache->c_lock));
+		if(mag->m_count == 0) {
+			atomicAdd(&(cache->c_handed), -1);
+			return NOPAGE;
+		}
+	}
+	mag->m_count--;
+	return mag->m_objects[mag->m_count];
+}
+
+/*
+* Function: takes an object back into the
+* magazine of this processor; a full magazine
+* is first drained by a batch, back onto the
+* slabs, under the cache lock
+*/
+void cacheFree(cache_t* cache, memaddr object) {
+	magazine_t* mag = &(cache->c_mags[getPRID()]);
+	if(mag->m_count == MAGSIZE) {
+		spinLock(&(cache->c_lock));
+		while(mag->m_count > (MAGSIZE - MAGBATCH)) {
+			mag->m_count--;
+			slabFree(cache, mag->m_objects[mag->m_count]);
+		}
+		spinUnlock(&(cache->c_lock));
+	}
+	mag->m_objects[mag->m_count] = object;
+	mag->m_count++;
+	atomicAdd(&(cache->c_handed), -1);
+}
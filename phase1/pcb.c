@@ -1,9 +1,9 @@
 /*************************************************** pcb.c **************************************************************
 	pcb.c encpsulates the functionality of Process Control Blocks, henceforth known as pcb_t; the pcb.c module is
-	responsible for three major pcb_t functions: first, a free list of MAXPROC pcb_t are allocated - where
-	MAXPROC = 20; then, pcb_t themsleves are to keep a child-parent-sibling relationships, where the siblings of
+	responsible for three major pcb_t functions: first, pcb_t are allocated from a slab cache on the
+	kernel heap, up to a runtime limit of MAXPROC = 20 by default; then, pcb_t themsleves are to keep a child-parent-sibling relationships, where the siblings of
 	a pcb_t are kepted in a doulbey liked list that is null terminated; third, it is responsible
-	for keeping process queues of pcb_t to be allocated fromon and off the free list.
+	for keeping process queues of pcb_t to be allocated from and returned to the cache.
 
 	This module contributes function definitions and a few sample fucntion implementations  to the contributors put forth by
 	the Kaya OS project
@@ -18,10 +18,21 @@
 /* e files to include */
 #include "../e/pcb.e"
 #include "../e/asl.e"
+#include "../e/heap.e"
 
 /* globals */
-/* the pcb_t free list of size 20 */
-static pcb_PTR pcbFl_h;
+/* the pcb_t cache on the kernel heap, MAXPROC pcb_t by default */
+static cache_t pcbCache;
+/* the processor states and exception vectors kept apart from the pcb_t */
+static cache_t stateCache;
+static cache_t trapCache;
+/* the pid table: the pcb_t holding each slot, the generation of each
+slot, and the slots that are free; the nucleus only allocates and frees
+pcb_t with the process lock held, which guards it */
+static pcb_PTR pidTable[PIDSLOTS];
+static int pidGeneration[PIDSLOTS];
+static int pidFree[PIDSLOTS];
+static int pidFreeCount;
 
 
 /************************************************************************************************************************/
@@ -52,15 +63,25 @@ pcb_PTR cleanPcb(pcb_PTR p) {
 	p->p_prevSib = NULL;
 	/* clean its semaphore */
 	p->p_semAdd = NULL;
-	p->oldSys = NULL;
-	p->newSys = NULL;
-	p->oldPgm = NULL;
-	p->newPgm = NULL;
-	p->oldTlb = NULL;
-	p->newTlb = NULL;
+	p->p_semd = NULL;
 	/* phase 2 */
 	p->p_time = 0;
-	p->p_semAdd = NULL;
+	p->p_cpu = NOCPU;
+	p->p_affinity = ALLCPUS;
+	p->p_priority = DEFAULTPRIO;
+	p->p_level = DEFAULTPRIO;
+	p->p_boost = NOBOOST;
+	p->p_mutexes = 0;
+	p->p_held = NULL;
+	p->p_period = 0;
+	p->p_budget = 0;
+	p->p_deadline = 0;
+	p->p_runtime = 0;
+	p->p_misses = 0;
+	p->p_rtUtil = 0;
+	p->p_ready = FALSE;
+	p->p_doomed = FALSE;
+	p->p_heapBlock = NOPAGE;
 	/* returned the cleaned node */
 	return p;
 }
@@ -111,49 +132,80 @@ void MkHeadChild(pcb_PTR prnt, pcb_PTR p) {
 
 /*
 * Function: pcb_t that are no longer in use
-* are returned to the free list here; this simply
-* requires the uses of the already written
-* insertProcQ, but must be cleaned before they
-* are inserted onto the list pointed to by
-* insertProcQ - that is, the free list.
+* are returned to the pcb_t cache here; they
+* must be cleaned before they go back, and the
+* page they live in goes back to the kernel heap
+* once none of its pcb_t are in use
 */
 void freePcb(pcb_PTR p) {
+	pcb_PTR temp;
+	/* the process is off the block it ran on */
+	if(p->p_heapBlock != NOPAGE) {
+		freePages(p->p_heapBlock);
+	}
 	/* since it will prove detremental to process
 	management if a pcb_t has predefined values on it
 	before going to the free list, it must be cleaned first */
-	pcb_PTR temp = cleanPcb(p);
+	temp = cleanPcb(p);
 	/* now its cleaned */
 	p = temp;
-	/* insert into a specified process queue - that is,
-	the free list; use the predefined encapsulated function
-	to achieve this */
-	insertProcQ(&(pcbFl_h), p);
+	/* its slot in the pid table is freed, and the next pid
+	handed out from it will be of a new generation */
+	pidTable[p->p_pid & (PIDSLOTS - 1)] = NULL;
+	pidGeneration[p->p_pid & (PIDSLOTS - 1)]++;
+	pidFree[pidFreeCount] = p->p_pid & (PIDSLOTS - 1);
+	pidFreeCount++;
+	p->p_pid = NOPID;
+	/* its state and exception vectors go back too */
+	cacheFree(&(stateCache), (memaddr) p->p_state);
+	p->p_state = NULL;
+	if(p->p_traps != NULL) {
+		cacheFree(&(trapCache), (memaddr) p->p_traps);
+		p->p_traps = NULL;
+	}
+	/* give it back to the cache */
+	cacheFree(&(pcbCache), (memaddr) p);
 }
 
 
 /*
-* Function: allocate a pcb_t from the free
-* free list; remove the pcb_t so that the
-* free list has n-1 pcb_t on it; if the
-* free list has no remaining free pcb_t
-* that is, the free list is empty,
-* simply return null to indicate that there
-* are no pcb_t remaining; otherwise, make the
-* free list n-1 pcb_t by calling removeProcQ()
-* given the free list as a pointer. Before the
-* pcb_t is returned, it is cleaned so that
-* can be appropriately used and a pointer to the
-* returned pcb_t is provided; additionally, the
-* pcb_t will be cleaned before it is returned
+* Function: allocate a pcb_t from the pcb_t
+* cache; if the cache has handed out as many
+* pcb_t as its limit allows, or the kernel heap
+* has no page left to grow it, simply return
+* null to indicate that there are no pcb_t
+* remaining. Before the pcb_t is returned, it
+* is cleaned so that can be appropriately used
+* and a pointer to the returned pcb_t is provided
 */
 pcb_PTR allocPcb() {
-	/* since removeProcQ is a generic function,
-	simply supply the address of the free list to
-	return the nth-1 element from said list */
-	pcb_PTR rmvdPcb = removeProcQ(&(pcbFl_h));
-	if(rmvdPcb != NULL) {
-		rmvdPcb = cleanPcb(rmvdPcb);
+	/* take one from the cache */
+	pcb_PTR rmvdPcb;
+	memaddr block;
+	int slot;
+	/* no pid left to give it */
+	if(pidFreeCount == 0) {
+		return NULL;
 	}
+	block = cacheAlloc(&(pcbCache));
+	if(block == NOPAGE) {
+		return NULL;
+	}
+	rmvdPcb = (pcb_PTR) block;
+	/* and a block for its processor state */
+	block = cacheAlloc(&(stateCache));
+	if(block == NOPAGE) {
+		cacheFree(&(pcbCache), (memaddr) rmvdPcb);
+		return NULL;
+	}
+	rmvdPcb->p_state = (state_t*) block;
+	rmvdPcb->p_traps = NULL;
+	/* give it a pid */
+	pidFreeCount--;
+	slot = pidFree[pidFreeCount];
+	pidTable[slot] = rmvdPcb;
+	rmvdPcb->p_pid = ((pidGeneration[slot] & PIDGENMASK) << PIDSLOTBITS) | slot;
+	rmvdPcb = cleanPcb(rmvdPcb);
 	/* now that the removed pcb is returned (or really, its
 	pointer is) it must be cleaned before it can be used */
 
@@ -162,29 +214,79 @@ pcb_PTR allocPcb() {
 }
 
 /*
-* Function: initializes the pcb_t
-* free list for pcb_t to be allocated to
-* by some predefined constant; this function
-* is an init call
+* Function: initializes the pcb_t cache,
+* bringing up the kernel heap it lives on
+* first; at most MAXPROC pcb_t may be handed
+* out until setPcbLimit says otherwise, and
+* never more than there are pids. This
+* function is an init call, and the first one
 */
 void initPcbs() {
-	/* statically declare the list of pcbs_t */
-	static pcb_t pcbTable[MAXPROC];
-	/* delcare the index */
 	int i;
-	/* make the head element in the array - that is,
-	the head of the free list - equal to null; by doing so, since
-	this function will ostensibily call insertProcQ, then by
-	having the head equal to null, the pcb_t pointed to by
-	p will have itself asigned to its previous and next - allowing
-	for the n+1th element to then be allocated to the nth previous
-	and next - and so on */
-	pcbFl_h = mkEmptyProcQ();
-	for (i = 0; i < MAXPROC; i++) {
-		/* insert the element into the freepcb function; since it takes
-		a pointer, simply supply the address */
-		freePcb(&(pcbTable[i]));
+	initHeap();
+	initCache(&(pcbCache), sizeof(pcb_t), MAXPROC);
+	/* every pcb_t has a state, so the pcb_t limit bounds them */
+	initCache(&(stateCache), sizeof(state_t), MAXINT);
+	initCache(&(trapCache), sizeof(trapvec_t), MAXINT);
+	/* every pid slot is free, lowest on top */
+	pidFreeCount = 0;
+	for(i = PIDSLOTS - 1; i >= 0; i--) {
+		pidTable[i] = NULL;
+		pidGeneration[i] = 0;
+		pidFree[pidFreeCount] = i;
+		pidFreeCount++;
+	}
+}
+
+/*
+* Function: finds the pcb_t with the given
+* pid in constant time: the slot is read off
+* the low bits of the pid, and the pcb_t in it
+* must carry the very same pid, so a pid whose
+* process has died matches nothing. Returns null
+* if there is no such process
+*/
+pcb_PTR pidLookup(int pid) {
+	pcb_PTR p;
+	if(pid < 0) {
+		return NULL;
+	}
+	p = pidTable[pid & (PIDSLOTS - 1)];
+	if((p == NULL) || (p->p_pid != pid)) {
+		return NULL;
+	}
+	return p;
+}
+
+/*
+* Function: attaches an empty set of exception
+* vectors to a pcb_t, the first time it issues
+* a SYS5; returns null if the kernel heap has
+* no room for them
+*/
+trapvec_t* attachTraps(pcb_PTR p) {
+	memaddr block = cacheAlloc(&(trapCache));
+	trapvec_t* traps = NULL;
+	if(block != NOPAGE) {
+		traps = (trapvec_t*) block;
+		traps->oldSys = NULL;
+		traps->newSys = NULL;
+		traps->oldPgm = NULL;
+		traps->newPgm = NULL;
+		traps->oldTlb = NULL;
+		traps->newTlb = NULL;
+		p->p_traps = traps;
 	}
+	return traps;
+}
+
+/*
+* Function: changes the number of pcb_t that
+* may be in use at once; the table size is a
+* runtime limit, bounded only by the heap
+*/
+void setPcbLimit(int limit) {
+	setCacheLimit(&(pcbCache), limit);
 }
 
 
@@ -235,9 +337,10 @@ void insertProcQ(pcb_PTR* tp, pcb_PTR p) {
 		reasign the pointers to account for the newly
 		added element */
 		p->p_next = (*tp)->p_next;
+		/* the head now has the newest element as its previous */
+		p->p_next->p_prev = p;
 		/* the newest element has the tail as its previous */
 		(*tp)->p_next = p;
-		(*tp)->p_next->p_prev = p;
 		p->p_prev = (*tp);
 
 	}
@@ -285,7 +388,7 @@ pcb_PTR outProcQ(pcb_PTR* tp, pcb_PTR p) {
 					adjust the adjacent pcb_t tp accordingly */
 					rmvdPcb = (*tp);
 					/* reallocate pointers */
-					(*tp)->p_next->p_prev = (*tp)->p_next;
+					(*tp)->p_next->p_prev = (*tp)->p_prev;
 					(*tp)->p_prev->p_next = (*tp)->p_next;
 					/* reasign the tp - someones lucky day */
 					(*tp) = (*tp)->p_prev;
@@ -368,6 +471,29 @@ pcb_PTR removeProcQ(pcb_PTR* tp) {
 	return rmvdPcb;
 }
 
+/*
+* Function: removes a pcb_t that is known to be
+* on the process queue pointed to by tp; unlike
+* outProcQ, it does not search the queue for it,
+* since the pcb_t's own links say where it is - so
+* this takes constant time
+*/
+void unlinkProcQ(pcb_PTR* tp, pcb_PTR p) {
+	if(p->p_next == p) {
+		/* it was the only one */
+		(*tp) = mkEmptyProcQ();
+	} else {
+		p->p_next->p_prev = p->p_prev;
+		p->p_prev->p_next = p->p_next;
+		/* the tail moves back a pcb_t */
+		if((*tp) == p) {
+			(*tp) = p->p_prev;
+		}
+	}
+	p->p_next = NULL;
+	p->p_prev = NULL;
+}
+
 
 /*
 * Function: returns a pointer to the head
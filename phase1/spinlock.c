@@ -0,0 +1,77 @@
+/*************************************************** spinlock.c *********************************************************
+	spinlock.c provides the locks the nucleus is built on once more than one processor runs it. A spinlock is a
+	word that is NOLOCK while free and one more than the id of the holding processor while taken; it is taken with
+	the compare and swap of the processor, spinning until the swap succeeds. The nucleus runs with interrupts off,
+	so a lock is never held across an interrupt, and it is only ever held for a few list operations. The module also
+	provides an atomic add, for the counts that are shared by the processors but guarded by no lock of their own, and
+	atomic bit operations for the masks of processors.
+
+	This module contributes function definitions and a few sample fucntion implementations to the contributors put forth by
+	the Kaya OS project
+
+***************************************************** spinlock.c *******************************************************/
+
+
+/* h files to include */
+#include "../h/const.h"
+#include "../h/types.h"
+/* e files to include */
+#include "../e/spinlock.e"
+/* include the µmps2 library */
+#include "/usr/local/include/umps2/umps/libumps.e"
+
+
+/************************************************************************************************************************/
+/************************************************** SPINLOCKS ***********************************************************/
+/************************************************************************************************************************/
+
+/*
+* Function: takes the lock, spinning
+* until the processor holding it lets go
+*/
+void spinLock(spinlock_t* lock) {
+	while(!CAS(lock, NOLOCK, getPRID() + 1)) {
+		/* spin */
+	}
+}
+
+/*
+* Function: lets go of the lock
+*/
+void spinUnlock(spinlock_t* lock) {
+	(*lock) = NOLOCK;
+}
+
+/*
+* Function: adds delta to the word as one
+* step, retrying when another processor
+* changed the word in between
+*/
+void atomicAdd(int* word, int delta) {
+	int old;
+	do {
+		old = (*word);
+	} while(!CAS((unsigned int*) word, (unsigned int) old, (unsigned int) (old + delta)));
+}
+
+/*
+* Function: sets the given bits of the
+* word as one step
+*/
+void atomicSet(unsigned int* word, unsigned int bits) {
+	unsigned int old;
+	do {
+		old = (*word);
+	} while(!CAS(word, old, old | bits));
+}
+
+/*
+* Function: clears the given bits of the
+* word as one step
+*/
+void atomicClear(unsigned int* word, unsigned int bits) {
+	unsigned int old;
+	do {
+		old = (*word);
+	} while(!CAS(word, old, old & ~bits));
+}
@@ -25,6 +25,7 @@
 #include "../e/exceptions.e"
 #include "../e/pcb.e"
 #include "../e/asl.e"
+#include "../e/spinlock.e"
 /* include the µmps2 library */
 #include "/usr/local/include/umps2/umps/libumps.e"
 
@@ -64,89 +65,181 @@ static int findSemaphoreIndex(int lineNumber, int deviceNumber, int flag) {
 * performs a context switch. Otherwise, the process dies
 */
 static void passUpOrDie(int callNumber, state_PTR old) {
+    /* the exception vectors, if a SYS5 has attached them */
+    trapvec_t* traps = currentProcess->p_traps;
     /* get the call number */
     switch(callNumber) {
         /* System trap exception */
         case SYSTRAP:
             /* has the systrap handler been set up? */
-            if(currentProcess->newSys == NULL) {
+            if((traps == NULL) || (traps->newSys == NULL)) {
                 /* no - it dies */
                 terminateProcess();
             } else {
                 /* pass it up to the appropriate handler */
-                copyState(old, currentProcess->oldSys);
+                copyState(old, traps->oldSys);
                 /* context switch */
-                contextSwitch(currentProcess->newSys);
+                contextSwitch(traps->newSys);
             }
             break;
         /* Translation Lookaside Buffer Exception */
         case TLBTRAP:
-            if(currentProcess->newTlb == NULL) {
+            if((traps == NULL) || (traps->newTlb == NULL)) {
                 /* no - it dies */
                 terminateProcess();
             } else {
                 /* pass it up to the appropriate handler */
-                copyState(old, currentProcess->oldTlb);
+                copyState(old, traps->oldTlb);
                 /* context switch */
-                contextSwitch(currentProcess->newTlb);
+                contextSwitch(traps->newTlb);
             }
             break;
         /* Program Trap Exception */
         case PROGTRAP:
-            if(currentProcess->newPgm == NULL) { 
+            if((traps == NULL) || (traps->newPgm == NULL)) { 
                 /* no - it dies */
                 terminateProcess();
             } else {
                 /* pass it up to the appropriate handler */
-                copyState(old, currentProcess->oldPgm);
+                copyState(old, traps->oldPgm);
                 /* context switch */
-                contextSwitch(currentProcess->newPgm);
+                contextSwitch(traps->newPgm);
             }
             break;
         }
 }
 
+/*
+* Function: Yank Process
+* A terminate progeny helper: takes a process other than the 
+* current one off the semaphore or the run queue it is on, and 
+* frees it. The process may be moved by another processor while 
+* we look - woken, dispatched or stolen - so where it seems to be 
+* is checked again under the lock of that place. A process that 
+* is on neither is running on another processor and cannot be 
+* freed under its feet: it is marked doomed, and that processor 
+* reaps it before it would block or dispatch it. Having marked it, 
+* we look once more, in case it was blocked or made ready just 
+* before it could see the mark. A blocking process looks at the mark 
+* only after it is on the semaphore, so if we miss it there it sees 
+* the mark and takes itself off; it reaps itself under the process 
+* lock, which we hold, so it is not freed while we look. Returns 
+* TRUE if the process was freed here.
+*/
+static int yankProcess(pcb_PTR p) {
+    int* semaphore;
+    int marked = FALSE;
+    while(TRUE) {
+        semaphore = p->p_semAdd;
+        if(semaphore != NULL) {
+            lockSemaphore(semaphore);
+            if(p->p_semAdd == semaphore) {
+                outBlocked(p);
+                /* if the semaphore greater than 0 and less than 48, then
+                it is a device semapore */
+                if(semaphore >= &(semdTable[0]) && semaphore <= &(semdTable[CLOCK])) {
+                    /* we have 1 less waiting process */
+                    atomicAdd(&softBlockedCount, -1);
+                } else {
+                    /* not a device semaphore */
+                    (*semaphore)++;
+                }
+                unlockSemaphore(semaphore);
+                releaseMutexes(p);
+                freePcb(p);
+                return TRUE;
+            }
+            unlockSemaphore(semaphore);
+        } else if(p->p_ready) {
+            /* yank the process from the ready queue */
+            if(unready(p)) {
+                releaseMutexes(p);
+                freePcb(p);
+                return TRUE;
+            }
+        } else if(marked) {
+            /* still running; its processor reaps it */
+            return FALSE;
+        } else {
+            p->p_doomed = TRUE;
+            marked = TRUE;
+        }
+    }
+}
+
+/* the utilization of a real-time process, in thousandths, rounded up */
+static int rtUtilization(cpu_t period, cpu_t budget) {
+    return ((budget * UTILSCALE) + period - 1) / period;
+}
+
+/*
+* Function: Leave Real-Time
+* Gives the utilization a real-time process was admitted with back 
+* to its processor, when it is terminated or changes class. It is 
+* given back once: a process doomed on another processor may still 
+* terminate itself or change class before it is reaped, and it keeps 
+* its period until then, which its run queue is picked by. The 
+* utilization of the processors is guarded by the process lock, 
+* which the caller holds.
+*/
+static void leaveRealTime(pcb_PTR p) {
+    int cpu;
+    if(p->p_rtUtil == 0) {
+        return;
+    }
+    /* it is pinned to the processor that admitted it */
+    for(cpu = 0; (p->p_affinity & (1 << cpu)) == 0; cpu++) {
+        /* look further */
+    }
+    cpus[cpu].c_rtUtil -= p->p_rtUtil;
+    p->p_rtUtil = 0;
+}
+
 /* 
 * Function: Terminate Progeny
 * The syscall 2 - terminate process - helper function.
-* Will beform tail recursion on the current process, killing 
-* all of it's progeny until there are none remaining. Then, it wil
-* check if the process is in a semaphore, is the current process,
-* or is in the ready queue. 
-*/
-static void terminateProgeny(pcb_PTR p) {
-    /* kill each progeny */
-     while(!emptyChild(p)) {
-        /* perform tail recursion */
-        terminateProgeny(removeChild(p));
-     }
-     /* n-1 processes left */
-     processCount--;
-     /* check of the pcb_t has a semaphore address */
-     if (p->p_semAdd != NULL) {
-        /* get the semaphore */
-        int* semaphore = p->p_semAdd;
-        /* call outblocked on the pcb_t */
-        outBlocked(p);
-        /* if the semaphore greater than 0 and less than 48, then
-        it is a device semapore */
-        if(semaphore >= &(semdTable[0]) && semaphore <= &(semdTable[CLOCK])) {
-            /* we have 1 less waiting process */
-            softBlockedCount--;
-        } else {
-            /* not a device semaphore */
-            (*semaphore)++;
+* Kills a process and all of its progeny in post-order, without
+* recursion, so a deep tree cannot overflow the kernel stack:
+* it walks down the first-child links to a leaf, kills the leaf
+* (which is then its parent's first child, so it comes off in
+* constant time), and goes back up to the parent to do the same
+* until the process itself is a leaf. Each pcb_t comes off the
+* ready queue or its semaphore in constant time, and the process
+* count is adjusted once at the end; a process that is running
+* on another processor is counted when it is reaped. The process
+* must already be out of its parent's child list, and the caller
+* holds the process lock.
+*/
+static void terminateProgeny(pcb_PTR root) {
+    pcb_PTR p = root;
+    pcb_PTR parent;
+    int killed = 0;
+    while(TRUE) {
+        /* down to a leaf */
+        while(!emptyChild(p)) {
+            p = p->p_child;
         }
-     } else if(p == currentProcess){
-         /* yank the process from the parent */
-         outChild(currentProcess);
-     } else {
-         /* yank the process from the ready queue */
-         outProcQ(&(readyQueue), p);
-     }
-     /* there are no mo children, so the process itself is free */
-     freePcb(p);
- }
+        parent = NULL;
+        if(p != root) {
+            parent = p->p_prnt;
+            removeChild(parent);
+        }
+        leaveRealTime(p);
+        if(p == currentProcess) {
+            /* there are no mo children, so the process itself is free */
+            releaseMutexes(p);
+            freePcb(p);
+            killed++;
+        } else if(yankProcess(p)) {
+            killed++;
+        }
+        if(parent == NULL) {
+            break;
+        }
+        p = parent;
+    }
+    atomicAdd(&processCount, -killed);
+}
 
 /*
 * This service performs a P operation on the semaphore requested 
@@ -176,18 +269,38 @@ static void waitForIODevice(state_PTR state) {
     /* get the index of the device semaphore */
     int i = findSemaphoreIndex(lineNumber, deviceNumber, terminalReadFlag);
     int* semaphore = &(semdTable[i]);
+    lockSemaphore(semaphore);
     /* perform a P operation */
     (*semaphore)--;
     if((*semaphore) < 0) {
+        chargeCurrent();
+        /* copy the old syscall area to the new pcb_t state_t, before 
+        the interrupt handler can find it */
+        copyState(state, currentProcess->p_state);
         /* block the current process */
         insertBlocked(semaphore, currentProcess);
+        /* terminated meanwhile, it will not wait: the mark is looked at 
+        only once we are on the semaphore, so either we see it here or 
+        yankProcess sees us there */
+        if(currentProcess->p_doomed) {
+            outBlocked(currentProcess);
+            (*semaphore)++;
+            unlockSemaphore(semaphore);
+            reapCurrent();
+        }
         /* we have 1 more waiting process */
-        softBlockedCount++;
-        /* copy the old syscall area to the new pcb_t state_t */
-        copyState(state, &(currentProcess->p_state));
+        atomicAdd(&softBlockedCount, 1);
+        /* have the completion come here, where it will run */
+        steerDevice(i);
+        currentProcess = NULL;
+        unlockSemaphore(semaphore);
         /* get a new process */
         invokeScheduler();
     }
+    /* the device already finished; hand back the status the 
+    interrupt handler latched */
+    state->s_v0 = deviceStatus[i];
+    unlockSemaphore(semaphore);
     /* if no P operation can be done, simply context switch */
     contextSwitch(state);
 }
@@ -201,18 +314,32 @@ static void waitForIODevice(state_PTR state) {
  static void waitForClock(state_PTR state) {
      /* get the semaphore index of the clock timer */
      int *semaphore = (int*) &(semdTable[CLOCK]);
+     lockSemaphore(semaphore);
      /* perform a passeren operation */
      (*semaphore)--;
      if ((*semaphore) < 0)
      {
+         chargeCurrent();
+         /* copy from the old syscall area into the new pcb_state */
+         copyState(state, currentProcess->p_state);
          /* block the process */
          insertBlocked(semaphore, currentProcess);
-         /* copy from the old syscall area into the new pcb_state */
-         copyState(state, &(currentProcess->p_state));
+         /* terminated meanwhile, it will not wait */
+         if(currentProcess->p_doomed) {
+             outBlocked(currentProcess);
+             (*semaphore)++;
+             unlockSemaphore(semaphore);
+             reapCurrent();
+         }
          /* increment the number of waiting processes */
-         softBlockedCount++;
+         atomicAdd(&softBlockedCount, 1);
+         currentProcess = NULL;
+         unlockSemaphore(semaphore);
+         invokeScheduler();
      }
-     invokeScheduler();
+     unlockSemaphore(semaphore);
+     /* the tick already came */
+     contextSwitch(state);
 }
 
 /* 
@@ -222,7 +349,7 @@ static void waitForIODevice(state_PTR state) {
 */
  static void getCpuTime(state_PTR state) {
         /* copy the state from the old syscall into the pcb_t's state */
-        copyState(state, &(currentProcess->p_state));
+        copyState(state, currentProcess->p_state);
         /* the clock can be started by placing a new value in the 
         STCK ROM function */
         cpu_t stopTOD;
@@ -232,10 +359,10 @@ static void waitForIODevice(state_PTR state) {
         cpu_t elapsedTime = stopTOD - startTOD;
         currentProcess->p_time = (currentProcess->p_time) + elapsedTime;
         /* store the state in the pcb_t's v0 register */
-        currentProcess->p_state.s_v0 = currentProcess->p_time;
+        currentProcess->p_state->s_v0 = currentProcess->p_time;
         /* start the clock for the start TOD */
         STCK(startTOD);
-        contextSwitch(&(currentProcess->p_state));
+        contextSwitch(currentProcess->p_state);
 }
 
 /*
@@ -245,6 +372,14 @@ static void waitForIODevice(state_PTR state) {
 * been set up, then the process is issued a sys2 - termination 
 */
 static void specifyExceptionsStateVector(state_PTR state) {
+    /* the vectors are attached on the first SYS5 */
+    trapvec_t* traps = currentProcess->p_traps;
+    if(traps == NULL) {
+        traps = attachTraps(currentProcess);
+        if(traps == NULL) {
+            terminateProcess();
+        }
+    }
     /* get the exception from the a1 register */
     switch(state->s_a1) {
         /* check if the specified exception is a translation 
@@ -252,34 +387,34 @@ static void specifyExceptionsStateVector(state_PTR state) {
         case TLBTRAP:
             /* if the new tlb has already been set up,
             kill the process */
-            if(currentProcess->newTlb != NULL) {
+            if(traps->newTlb != NULL) {
                 terminateProcess();
             }
             /* store the syscall area state in the new tlb */
-            currentProcess->newTlb = (state_PTR) state->s_a3;
+            traps->newTlb = (state_PTR) state->s_a3;
             /* store the syscall area state in the old tlb*/
-            currentProcess->oldTlb = (state_PTR) state->s_a2;
+            traps->oldTlb = (state_PTR) state->s_a2;
             break;
         case PROGTRAP:
             /* if the new pgm has already been set up,
             kill the process */
-            if(currentProcess->newPgm != NULL) {
+            if(traps->newPgm != NULL) {
                 terminateProcess();
             }
             /* store the syscall area state in the new pgm */
-            currentProcess->newPgm = (state_PTR) state->s_a3;
-            currentProcess->oldPgm = (state_PTR) state->s_a2;
+            traps->newPgm = (state_PTR) state->s_a3;
+            traps->oldPgm = (state_PTR) state->s_a2;
             break;
         case SYSTRAP:
             /* if the new systrap has already been set up,
             kill the process */
-            if(currentProcess->newSys != NULL) {
+            if(traps->newSys != NULL) {
                 terminateProcess();
             }
             /* store the syscall area state in the new pgm */
-            currentProcess->newSys = (state_PTR) state->s_a3;
+            traps->newSys = (state_PTR) state->s_a3;
             /* store the syscall area state in the old pgm*/
-            currentProcess->oldSys = (state_PTR) state->s_a2;
+            traps->oldSys = (state_PTR) state->s_a2;
             break;
     }
     contextSwitch(state);
@@ -296,22 +431,30 @@ static void specifyExceptionsStateVector(state_PTR state) {
 static void passeren(state_PTR state) {
     /* get the semaphore in the s_a1 */
     int *semaphore = (int*) state->s_a1;
+    /* only the semaphores in the same asl bucket wait for us */
+    lockSemaphore(semaphore);
     /* decrement teh semaphore */
     (*(semaphore))--;
     if ((*(semaphore)) < 0) {
-        cpu_t stopTOD;
-        STCK(stopTOD);
-        /*Store elapsed time*/
-        int elapsedTime = stopTOD - startTOD;
         /* add the elapsed time to the current process */
-        currentProcess->p_time = currentProcess->p_time + elapsedTime;
+        chargeCurrent();
         /* copy from the old syscall area to the new process's state */
-        copyState(state, &(currentProcess->p_state));
+        copyState(state, currentProcess->p_state);
         /* the process now must wait */
         insertBlocked(semaphore, currentProcess);
+        /* terminated meanwhile, it will not wait */
+        if(currentProcess->p_doomed) {
+            outBlocked(currentProcess);
+            (*(semaphore))++;
+            unlockSemaphore(semaphore);
+            reapCurrent();
+        }
+        currentProcess = NULL;
+        unlockSemaphore(semaphore);
         /* get a new job */
         invokeScheduler();
     }
+    unlockSemaphore(semaphore);
     /* if the semaphore is not less than zero, do not 
     block the process, just load the new state */
     contextSwitch(state);
@@ -329,6 +472,7 @@ static void verhogen(state_PTR state) {
     /* the semaphore is placed in the a1 register of the 
     passed in state_t */
     int* semaphore = (int*) state->s_a1;
+    lockSemaphore(semaphore);
     /* increment the semaphore - the V operation on 
     the semaphore */
     (*(semaphore))++;
@@ -342,9 +486,10 @@ static void verhogen(state_PTR state) {
         queue - baring its not null */
         if(newProcess != NULL) {
             /* place it in the ready queue */
-            insertProcQ(&(readyQueue), newProcess);
+            makeReady(newProcess);
         }
     }
+    unlockSemaphore(semaphore);
     /* perform a context switch on the requested process */
     contextSwitch(state);
 }
@@ -360,11 +505,14 @@ static void terminateProcess() {
     /* if there are no children, simply decrement 
     the process count, remove the current process, and 
     free up a pcb_t */
+    lockProcesses();
+    outChild(currentProcess);
     if(emptyChild(currentProcess)) {
+        leaveRealTime(currentProcess);
         /* n-1 processes remaining */
-        processCount--;
-        outChild(currentProcess);
+        atomicAdd(&processCount, -1);
         /* free the process */
+        releaseMutexes(currentProcess);
         freePcb(currentProcess);
     } else {
         /* calls the terminate progeny helper function */
@@ -374,6 +522,7 @@ static void terminateProcess() {
     the scheduler needs to be called in order to get a new
     processes */
     currentProcess = NULL;
+    unlockProcesses();
     /* reschedule a new process */
     invokeScheduler();
 }
@@ -389,20 +538,28 @@ static void terminateProcess() {
 * case, a context switch occurs. 
 */
 static void createProcess(state_PTR state) {
+    pcb_PTR p;
+    lockProcesses();
     /* grab a new process */
-    pcb_PTR p = allocPcb();
+    p = allocPcb();
     if(p != NULL) {
         /* there is now n+1 running processes */
-        processCount++;
+        atomicAdd(&processCount, 1);
+        /* copy the content from the state's 
+        $a1 register to the new pcb_t's state, before 
+        another processor can dispatch it */
+        state_PTR temp = (state_PTR) state->s_a1;
+        copyState(temp, p->p_state);
         /* since there is a free process, if the process 
         has a parent, it is inserted into the parent, and then
         placed in the ready queue */
         insertChild(currentProcess, p);
-        insertProcQ(&(readyQueue), p);
-        /* copy the content from the state's 
-        $a1 register to the new pcb_t's state */
-        state_PTR temp = (state_PTR) state->s_a1;
-        copyState(temp, &(p->p_state));
+        /* it may run where its parent may */
+        p->p_affinity = currentProcess->p_affinity;
+        /* and at its parent's priority */
+        p->p_priority = currentProcess->p_priority;
+        p->p_level = currentProcess->p_priority;
+        makeReady(p);
         /* acknowledge the success of the new process
         by placing 0 in the state's $v0 register */ 
         state->s_v0 = SUCCESS;
@@ -412,10 +569,403 @@ static void createProcess(state_PTR state) {
         -1 in the state's $v0 register */
         state->s_v0 = FAILURE;
     }
+    unlockProcesses();
     /* context switch */
     contextSwitch(state);
 }
 
+/*
+* Function: Get PID - Syscall 20
+* Places the process id of the caller in $v0.
+*/
+static void getPid(state_PTR state) {
+    state->s_v0 = currentProcess->p_pid;
+    contextSwitch(state);
+}
+
+/*
+* Function: Is Ancestor
+* Is the first pcb_t the second one or one of its
+* ancestors? If so, terminating the first takes the
+* second down with it.
+*/
+static int isAncestor(pcb_PTR p, pcb_PTR q) {
+    while(q != NULL) {
+        if(q == p) {
+            return TRUE;
+        }
+        q = q->p_prnt;
+    }
+    return FALSE;
+}
+
+/*
+* Function: Terminate PID - Syscall 21
+* Terminates the process whose id is in $a1, along with all of
+* its progeny, without the caller having to walk the process tree.
+* Places SUCCESS in $v0, or FAILURE if there is no such process.
+* If the caller was among those terminated, a new job is acquired.
+*/
+static void terminatePid(state_PTR state) {
+    pcb_PTR p;
+    int suicide;
+    lockProcesses();
+    p = pidLookup(state->s_a1);
+    if(p == NULL) {
+        unlockProcesses();
+        state->s_v0 = FAILURE;
+        contextSwitch(state);
+    }
+    suicide = isAncestor(p, currentProcess);
+    /* yank it from its parent, then kill it and its progeny */
+    outChild(p);
+    terminateProgeny(p);
+    if(suicide) {
+        currentProcess = NULL;
+        unlockProcesses();
+        invokeScheduler();
+    }
+    unlockProcesses();
+    state->s_v0 = SUCCESS;
+    contextSwitch(state);
+}
+
+/*
+* Function: Signal PID - Syscall 22
+* Signals the process whose id is in $a1: if it is blocked on a
+* semaphore other than a device semaphore, it is taken off the
+* semaphore - which gets its P undone - and made ready, with FAILURE
+* in its $v0 to tell it the wait was cut short. Places SUCCESS in the
+* caller's $v0 if the process was woken, FAILURE if there is no such
+* process or it was not waiting.
+*/
+static void signalPid(state_PTR state) {
+    pcb_PTR p;
+    int* semaphore;
+    state->s_v0 = FAILURE;
+    lockProcesses();
+    p = pidLookup(state->s_a1);
+    if((p != NULL) && (p->p_semAdd != NULL)) {
+        semaphore = p->p_semAdd;
+        /* device waits finish when the device does */
+        if(semaphore < &(semdTable[0]) || semaphore > &(semdTable[CLOCK])) {
+            lockSemaphore(semaphore);
+            /* a V on another processor may have beaten us to it */
+            if(p->p_semAdd == semaphore) {
+                outBlocked(p);
+                (*semaphore)++;
+                p->p_state->s_v0 = FAILURE;
+                makeReady(p);
+                state->s_v0 = SUCCESS;
+            }
+            unlockSemaphore(semaphore);
+        }
+    }
+    unlockProcesses();
+    contextSwitch(state);
+}
+
+/*
+* Function: Set Affinity - Syscall 23
+* Sets the processors the caller may run on to the mask in $a1, a 
+* bit per processor. Places SUCCESS in $v0, or FAILURE if the mask 
+* names no processor that is up, or the caller is real-time and so 
+* pinned where it was admitted. If this processor is not in the new 
+* mask, the caller moves to the run queue of one that is, and a new 
+* job is acquired here.
+*/
+static void setAffinity(state_PTR state) {
+    unsigned int mask = state->s_a1 & onlineCpus;
+    if((mask == 0) || (currentProcess->p_period != 0)) {
+        state->s_v0 = FAILURE;
+        contextSwitch(state);
+    }
+    currentProcess->p_affinity = mask;
+    state->s_v0 = SUCCESS;
+    if((mask & (1 << getPRID())) == 0) {
+        chargeCurrent();
+        copyState(state, currentProcess->p_state);
+        /* make ready picks an allowed processor */
+        makeReady(currentProcess);
+        currentProcess = NULL;
+        invokeScheduler();
+    }
+    contextSwitch(state);
+}
+
+/*
+* Function: Get Affinity - Syscall 24
+* Places the mask of processors the caller may run on in $v0.
+*/
+static void getAffinity(state_PTR state) {
+    state->s_v0 = currentProcess->p_affinity;
+    contextSwitch(state);
+}
+
+/*
+* Function: Set Priority - Syscall 25
+* Sets the priority of the caller to the level in $a1, 0 being the 
+* highest, like nice(2): a process may lower its priority as it 
+* likes, but may not raise it above its parent's. Places SUCCESS 
+* in $v0, or FAILURE if the level is out of those bounds. The 
+* parent is read under the process lock, as it may be terminating.
+*/
+static void setPriority(state_PTR state) {
+    int priority = (int) state->s_a1;
+    int highest = 0;
+    lockProcesses();
+    if(currentProcess->p_prnt != NULL) {
+        highest = currentProcess->p_prnt->p_priority;
+    }
+    if((priority < highest) || (priority >= PRIOLEVELS)) {
+        state->s_v0 = FAILURE;
+    } else {
+        currentProcess->p_priority = priority;
+        currentProcess->p_level = priority;
+        state->s_v0 = SUCCESS;
+    }
+    unlockProcesses();
+    contextSwitch(state);
+}
+
+/*
+* Function: Set Real-Time - Syscall 26
+* Puts the caller in the real-time class with the period in $a1 and 
+* the budget in $a2, in microseconds, or back in best effort if the 
+* period is 0. A real-time process may run for its budget in every 
+* period, and is dispatched ahead of the best-effort ones, earliest 
+* deadline first. It is admitted only to a processor in its affinity 
+* mask with the utilization to spare - the one with the most - and 
+* is pinned there, also after it goes back to best effort, until it 
+* sets its affinity again. Places SUCCESS in $v0, or FAILURE if the 
+* period and budget are out of bounds or no processor can take it, 
+* in which case it keeps its old class. If it was admitted to another 
+* processor, it moves there, and a new job is acquired here.
+*/
+static void setRealTime(state_PTR state) {
+    cpu_t period = (cpu_t) state->s_a1;
+    cpu_t budget = (cpu_t) state->s_a2;
+    int util;
+    int best = NOCPU;
+    int bestSpare = 0;
+    int spare;
+    int cpu;
+    state->s_v0 = FAILURE;
+    if((period < 0) || (period > MAXRTPERIOD) ||
+        ((period != 0) && ((budget <= 0) || (budget > period)))) {
+        contextSwitch(state);
+    }
+    lockProcesses();
+    /* charged as best effort, or in its old period, up to now */
+    chargeCurrent();
+    if(period == 0) {
+        leaveRealTime(currentProcess);
+        currentProcess->p_period = 0;
+        currentProcess->p_budget = 0;
+        unlockProcesses();
+        state->s_v0 = SUCCESS;
+        contextSwitch(state);
+    }
+    util = rtUtilization(period, budget);
+    for(cpu = 0; cpu < NCPUS; cpu++) {
+        if((currentProcess->p_affinity & onlineCpus & (1 << cpu)) == 0) {
+            continue;
+        }
+        spare = RTUTILBOUND - cpus[cpu].c_rtUtil;
+        /* what it has now is spare, if it stays */
+        spare += currentProcess->p_rtUtil;
+        if((spare >= util) && ((best == NOCPU) || (spare > bestSpare))) {
+            best = cpu;
+            bestSpare = spare;
+        }
+    }
+    if(best == NOCPU) {
+        unlockProcesses();
+        contextSwitch(state);
+    }
+    leaveRealTime(currentProcess);
+    cpus[best].c_rtUtil += util;
+    currentProcess->p_rtUtil = util;
+    currentProcess->p_affinity = (1 << best);
+    currentProcess->p_period = period;
+    currentProcess->p_budget = budget;
+    currentProcess->p_runtime = 0;
+    STCK(currentProcess->p_deadline);
+    currentProcess->p_deadline = currentProcess->p_deadline + period;
+    unlockProcesses();
+    state->s_v0 = SUCCESS;
+    if(best != getPRID()) {
+        copyState(state, currentProcess->p_state);
+        makeReady(currentProcess);
+        currentProcess = NULL;
+        invokeScheduler();
+    }
+    contextSwitch(state);
+}
+
+/*
+* Function: Get Misses - Syscall 27
+* Places in $v0 the number of deadlines the caller has missed as a 
+* real-time process: periods that ended while it was ready to run 
+* and had budget left.
+*/
+static void getMisses(state_PTR state) {
+    state->s_v0 = currentProcess->p_misses;
+    contextSwitch(state);
+}
+
+/* the priority a waiter passes on to the holder of a mutex */
+static int waiterPriority(pcb_PTR p) {
+    if(p->p_period != 0) {
+        return 0;
+    }
+    return EFFPRIO(p);
+}
+
+/* records a process as the holder of a mutex */
+static void holdMutex(pcb_PTR p, mutex_PTR mutex) {
+    mutex->m_owner = p->p_pid;
+    mutex->m_next = p->p_held;
+    p->p_held = mutex;
+    p->p_mutexes++;
+}
+
+/* a process gives up a mutex; once it holds none, it goes back to its own priority */
+static void dropMutex(pcb_PTR p, mutex_PTR mutex) {
+    mutex_PTR* link = &(p->p_held);
+    while(*link != mutex) {
+        link = &((*link)->m_next);
+    }
+    *link = mutex->m_next;
+    mutex->m_owner = NOPID;
+    p->p_mutexes--;
+    if(p->p_mutexes == 0) {
+        p->p_boost = NOBOOST;
+        p->p_level = EFFPRIO(p);
+    }
+}
+
+/*
+* Function: Hand Off Mutex
+* The V of a mutex nobody holds any more. The mutex is handed to the 
+* waiter of the highest priority - the first of them, if there are 
+* several - which inherits the priority of those still waiting. Called 
+* with the process lock and the lock of the mutex held.
+*/
+static void handOffMutex(mutex_PTR mutex) {
+    pcb_PTR head;
+    pcb_PTR p;
+    pcb_PTR waiter = NULL;
+    int boost = NOBOOST;
+    mutex->m_value++;
+    head = headBlocked(&(mutex->m_value));
+    if((mutex->m_value <= 0) && (head != NULL)) {
+        p = head;
+        do {
+            if((waiter == NULL) || (waiterPriority(p) < waiterPriority(waiter))) {
+                waiter = p;
+            }
+            p = p->p_next;
+        } while(p != head);
+        outBlocked(waiter);
+        head = headBlocked(&(mutex->m_value));
+        if(head != NULL) {
+            p = head;
+            do {
+                boost = MIN(boost, waiterPriority(p));
+                p = p->p_next;
+            } while(p != head);
+        }
+        holdMutex(waiter, mutex);
+        waiter->p_boost = MIN(waiter->p_boost, boost);
+        waiter->p_state->s_v0 = SUCCESS;
+        makeReady(waiter);
+    }
+}
+
+/*
+* Function: Lock Mutex - Syscall 28
+* A P on the mutex whose address is in $a1, which also records the 
+* caller as its holder. If the mutex is held, the caller waits, and 
+* the holder inherits the caller's priority if it is higher than its 
+* own, so a process of middling priority cannot keep it off the 
+* processor while the caller waits. Places SUCCESS in $v0 once the 
+* caller holds the mutex; a wait cut short by SIGNALPID gets FAILURE. 
+* The holder is looked up by its pid under the process lock, as it 
+* may have been terminated meanwhile. The inheritance goes one level 
+* only: a holder that itself waits on another mutex does not pass the 
+* priority on to the holder of that one.
+*/
+static void lockMutex(state_PTR state) {
+    mutex_PTR mutex = (mutex_PTR) state->s_a1;
+    pcb_PTR owner;
+    lockProcesses();
+    lockSemaphore(&(mutex->m_value));
+    mutex->m_value--;
+    if(mutex->m_value < 0) {
+        owner = pidLookup(mutex->m_owner);
+        if(owner != NULL) {
+            boostProcess(owner, waiterPriority(currentProcess));
+        }
+        chargeCurrent();
+        copyState(state, currentProcess->p_state);
+        insertBlocked(&(mutex->m_value), currentProcess);
+        currentProcess = NULL;
+        unlockSemaphore(&(mutex->m_value));
+        unlockProcesses();
+        invokeScheduler();
+    }
+    holdMutex(currentProcess, mutex);
+    unlockSemaphore(&(mutex->m_value));
+    unlockProcesses();
+    state->s_v0 = SUCCESS;
+    contextSwitch(state);
+}
+
+/*
+* Function: Unlock Mutex - Syscall 29
+* A V on the mutex whose address is in $a1. Once the caller holds no 
+* mutex, it goes back to its own priority. The mutex is handed to the 
+* waiter of the highest priority - the first of them, if there are 
+* several - which inherits the priority of those still waiting. Places 
+* SUCCESS in $v0, or FAILURE, leaving the mutex alone, if the caller 
+* does not hold it.
+*/
+static void unlockMutex(state_PTR state) {
+    mutex_PTR mutex = (mutex_PTR) state->s_a1;
+    lockProcesses();
+    lockSemaphore(&(mutex->m_value));
+    if(mutex->m_owner != currentProcess->p_pid) {
+        unlockSemaphore(&(mutex->m_value));
+        unlockProcesses();
+        state->s_v0 = FAILURE;
+        contextSwitch(state);
+    }
+    dropMutex(currentProcess, mutex);
+    handOffMutex(mutex);
+    unlockSemaphore(&(mutex->m_value));
+    unlockProcesses();
+    state->s_v0 = SUCCESS;
+    contextSwitch(state);
+}
+
+/*
+* Function: Release Mutexes
+* Releases the mutexes a dying process still holds, each as if it had 
+* unlocked it, so their waiters do not wait on a dead holder forever. 
+* Called with the process lock held, before the pcb_t is freed.
+*/
+void releaseMutexes(pcb_PTR p) {
+    mutex_PTR mutex;
+    while(p->p_held != NULL) {
+        mutex = p->p_held;
+        lockSemaphore(&(mutex->m_value));
+        dropMutex(p, mutex);
+        handOffMutex(mutex);
+        unlockSemaphore(&(mutex->m_value));
+    }
+}
+
 /*
 * Function: User Mode Handler 
 * Gets called when the system is in user mode and 
@@ -426,7 +976,7 @@ static void createProcess(state_PTR state) {
 */
 static void userModeHandler(state_PTR state) {
     /* get the old program trap area */
-    state_PTR programTrapOldArea = (state_PTR) PRGMTRAPOLDAREA;
+    state_PTR programTrapOldArea = CPUAREA(PRGMTRAPOLDAREA);
     /* copy the old syscall area into the old program trap area */
     copyState(state, programTrapOldArea);
     /* set teh cause register to contain the RESERVED MASK */
@@ -443,6 +993,46 @@ static void userModeHandler(state_PTR state) {
 */
 static void syscallDispatch(int callNumber, state_PTR caller) {
     switch (callNumber) {
+        /* SYSCALL 29 */
+        case UNLOCKMUTEX:
+            unlockMutex(caller);
+            break;
+        /* SYSCALL 28 */
+        case LOCKMUTEX:
+            lockMutex(caller);
+            break;
+        /* SYSCALL 27 */
+        case GETMISSES:
+            getMisses(caller);
+            break;
+        /* SYSCALL 26 */
+        case SETREALTIME:
+            setRealTime(caller);
+            break;
+        /* SYSCALL 25 */
+        case SETPRIORITY:
+            setPriority(caller);
+            break;
+        /* SYSCALL 24 */
+        case GETAFFINITY:
+            getAffinity(caller);
+            break;
+        /* SYSCALL 23 */
+        case SETAFFINITY:
+            setAffinity(caller);
+            break;
+        /* SYSCALL 22 */
+        case SIGNALPID:
+            signalPid(caller);
+            break;
+        /* SYSCALL 21 */
+        case TERMINATEPID:
+            terminatePid(caller);
+            break;
+        /* SYSCALL 20 */
+        case GETPID:
+            getPid(caller);
+            break;
         /* SYSCALL 8 */
         case WAITFORIODEVICE:
             waitForIODevice(caller);
@@ -529,7 +1119,7 @@ void copyState(state_PTR from, state_PTR to) {
 */
  void programTrapHandler() {
     /* get the area in memory */
-    state_PTR oldState = (state_PTR) PRGMTRAPOLDAREA;
+    state_PTR oldState = CPUAREA(PRGMTRAPOLDAREA);
     /* pass up the process to its appropriate handler
     or kill it */
     passUpOrDie(PROGTRAP, oldState);
@@ -545,7 +1135,7 @@ void copyState(state_PTR from, state_PTR to) {
 */
  void translationLookasideBufferHandler() {
     /* get the area in memory */
-    state_PTR oldState = (state_PTR)TBLMGMTOLDAREA;
+    state_PTR oldState = CPUAREA(TBLMGMTOLDAREA);
     /* pass up the process to its appropriate handler
     or kill it */
     passUpOrDie(TLBTRAP, oldState);
@@ -564,7 +1154,7 @@ void copyState(state_PTR from, state_PTR to) {
  */ 
  void syscallHandler() {
     /* get the old syscall area in memory */
-    state_PTR caller = (state_PTR) SYSCALLOLDAREA;
+    state_PTR caller = CPUAREA(SYSCALLOLDAREA);
     /* increment the program counter by 1 word */
     caller->s_pc = caller->s_pc + 4;
     /* assume the system is in kernel mode */
@@ -579,11 +1169,11 @@ void copyState(state_PTR from, state_PTR to) {
         userMode = TRUE;
     }
     /* if the system is in user mode and makes a syscall 1-8 
-    request, it is then passed down to the user mode handler, 
-    where the cause register will be set to the reserved address; 
-    otherwise, if we are in kernel mode but a syscall >8 is made,
-    the syscall dispatch will account for this */
-    if((callNumber < 9) && (callNumber > 0) && userMode) {
+    (or one of the pid, affinity, priority, real-time and mutex syscalls) request, it is then passed down 
+    to the user mode handler, where the cause register will be set 
+    to the reserved address; otherwise, if we are in kernel mode but 
+    a syscall >8 is made, the syscall dispatch will account for this */
+    if((((callNumber < 9) && (callNumber > 0)) || ((callNumber >= GETPID) && (callNumber <= UNLOCKMUTEX))) && userMode) {
         /* pass responsibility to the user mode handler */
         userModeHandler(caller);
     } else {
@@ -27,12 +27,15 @@
 int processCount;
 /* the soft blocked count */
 int softBlockedCount;
-/* the current process */
-pcb_PTR currentProcess;
-/* the queue of ready processes */
-pcb_PTR readyQueue;
+/* the processors, each with its current process and timing */
+percpu_t cpus[NCPUS];
+/* the processors that came up, a bit per processor: the machine 
+configuration may have fewer than NCPUS */
+unsigned int onlineCpus;
 /* semaphore list */
 int semdTable[MAXSEMALLOC];
+/* the status of a device that finished before anyone waited on it */
+unsigned int deviceStatus[MAXSEMALLOC];
 
 /* 
 * Function: the boot squence for the OS; it will initalize process control blocks and 
@@ -41,9 +44,32 @@ int semdTable[MAXSEMALLOC];
 * which will delegate the rest of the OS, i.e. main will return 1
 */
 int main() {
+    /* the processor started by the secondaries */
+    state_t cpuStart;
+    int cpu;
+    int area;
+    int i;
     /* initalize global variables */
-    readyQueue = mkEmptyProcQ();
-    currentProcess = NULL;
+    for(cpu = 0; cpu < NCPUS; cpu++) {
+        cpus[cpu].c_current = NULL;
+        for(i = 0; i < PRIOLEVELS; i++) {
+            cpus[cpu].c_readyQueues[i] = mkEmptyProcQ();
+        }
+        cpus[cpu].c_readyMap = 0;
+        cpus[cpu].c_readyCount = 0;
+        cpus[cpu].c_rtQueue = mkEmptyProcQ();
+        cpus[cpu].c_rtUtil = 0;
+        cpus[cpu].c_dispatches = 0;
+        cpus[cpu].c_lock = NOLOCK;
+    }
+    for(i = 0; i < MAXASID; i++) {
+        asidCpus[i] = 0;
+    }
+    shootdownLock = NOLOCK;
+    shootdownPending = 0;
+    processLock = NOLOCK;
+    /* the others report in as they start */
+    onlineCpus = 1;
     processCount = 0;
     softBlockedCount = 0;
     /* the device register */
@@ -92,10 +118,10 @@ int main() {
 
     /* next, we address each semaphore in the ASL free list to have 
     an address of 0 */
-    int i;    
     for(i = 0; i < MAXSEMALLOC; i++) {
         /* intialize every semaphore to have a starting address of 0 */
         semdTable[i] = 0;
+        deviceStatus[i] = 0;
     }
 
     /* now, we start up the underlying data structures to support the rest of the 
@@ -104,18 +130,34 @@ int main() {
     initASL();
     /* allocated a process - just like before, we must now allocate memory according`ly */
     currentProcess = allocPcb();
-    currentProcess->p_state.s_sp = (RAMTOP - PAGESIZE);
-    currentProcess->p_state.s_pc = (memaddr) test; /* TODO IMPLEMENT TEST CODE */
-    currentProcess->p_state.s_t9 = (memaddr) test; /* TODO IMPLEMENT TEST CODE */
-    currentProcess->p_state.s_status = (ALLOFF | INTERRUPTSON | IM | TE);
+    currentProcess->p_state->s_sp = (RAMTOP - PAGESIZE);
+    currentProcess->p_state->s_pc = (memaddr) test; /* TODO IMPLEMENT TEST CODE */
+    currentProcess->p_state->s_t9 = (memaddr) test; /* TODO IMPLEMENT TEST CODE */
+    currentProcess->p_state->s_status = (ALLOFF | INTERRUPTSON | IM | TE);
     /* increment the process count, since we have one fired up */
     processCount++;
     /* insert the newly allocated process into the ready queue */
-    insertProcQ(&(readyQueue), currentProcess);
+    makeReady(currentProcess);
     /* its in the queue */
     currentProcess = NULL;
     /* load an interval */
     LDIT(INTERVAL);
+    /* spread the device interrupts across the processors */
+    initRouting();
+    /* start the secondary processors: their new areas are the ones 
+    above, each with a nucleus stack of its own, and they start out 
+    in the scheduler */
+    for(cpu = 1; cpu < NCPUS; cpu++) {
+        for(area = 0; area < CPUAREAS; area++) {
+            copyState((state_PTR) (INTRUPTOLDAREA + (area * sizeof(state_t))), &(cpus[cpu].c_areas[area]));
+            cpus[cpu].c_areas[area].s_sp = CPUSTACK(RAMTOP, cpu);
+        }
+        cpuStart.s_status = ALLOFF;
+        cpuStart.s_sp = CPUSTACK(RAMTOP, cpu);
+        cpuStart.s_pc = (memaddr) cpuEnter;
+        cpuStart.s_t9 = (memaddr) cpuEnter;
+        INITCPU(cpu, &(cpuStart), cpus[cpu].c_areas);
+    }
     /* call the scheduler */
     invokeScheduler();
 }
\ No newline at end of file
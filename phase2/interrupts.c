@@ -6,7 +6,9 @@
     caused by either a quantum ending or a psuedo clock timer. For semaphore devices, i.e. a disk, tape, network, printer 
     or terminal device, causes an interupt, a V operation is performed on that device's semaphore and implements the 
     shandshake. Furthermore, for all devices, the interrupt handler will insure that running processes' will not be
-    charged for time spent in the the interupt handler. 
+    charged for time spent in the the interupt handler. The device interrupts are spread across the processors
+    through the interrupt routing table: a device is sent to the processor a process waits on it from, and the
+    others are rebalanced by their interrupt rates on every pseudo-clock tick.
 
     This module contributes function definitions and a few sample fucntion implementations to the contributors put 
     forth by the Kaya OS project.
@@ -22,9 +24,20 @@
 #include "../e/initial.e"
 #include "../e/exceptions.e"
 #include "../e/scheduler.e"
+#include "../e/spinlock.e"
 /* include the µmps2 library */
 #include "/usr/local/include/umps2/umps/libumps.e"
 
+/* GLOBAL VARIABLES */
+/* the interrupts taken from each device since the last rebalance, 
+halved at every rebalance */
+static int deviceInterrupts[DEVENTRIES];
+/* the processor each device is routed to */
+static int deviceRoute[DEVENTRIES];
+/* guards the routes and the interrupt routing table; taken last */
+static spinlock_t routeLock;
+/* END OF GLOBAL VARIABLES */
+
 
 /************************************************************************************************************************/
 /******************************************** HELPER FUNCTIONS  *********************************************************/
@@ -72,7 +85,7 @@ static void exitInterruptHandler(cpu_t startTime) {
     /* do we have a current process? */
     if(currentProcess != NULL) {
         /* get the old interrupt area */
-        state_PTR oldInterrupt = (memaddr)INTRUPTOLDAREA;
+        state_PTR oldInterrupt = CPUAREA(INTRUPTOLDAREA);
         cpu_t endTime;
         /* start the clock by placing a new value in 
         the ROM supported STCK function */
@@ -80,10 +93,14 @@ static void exitInterruptHandler(cpu_t startTime) {
         /* find the startedTOD */
         cpu_t elapsedTime = (endTime - startTime);
         startTOD = startTOD + elapsedTime;
+        /* charge it for its time, up to the interrupt */
+        chargeCurrent();
         /* copy the state from the old interrupt area to the current state */
-        copyState(oldInterrupt, &(currentProcess->p_state));
-        /* insert the new pricess in the ready queue */
-        insertProcQ(&(readyQueue), currentProcess);
+        copyState(oldInterrupt, currentProcess->p_state);
+        /* insert the new pricess in the ready queue; another processor 
+        may take it from there, so it is no longer ours */
+        makeReady(currentProcess);
+        currentProcess = NULL;
     }
     /* get a new process */
     invokeScheduler();
@@ -113,6 +130,124 @@ static int getLineNumber(unsigned int cause) {
     return finding;
 }
 
+/************************************************************************************************************************/
+/********************************************** INTERRUPT ROUTING *******************************************************/
+/************************************************************************************************************************/
+
+/*
+* Function: Route Entry
+* Sends the interrupts of a device to a processor, by writing its 
+* entry of the interrupt routing table. Called with the route lock
+* held, or at boot before the other processors start.
+*/
+static void routeEntry(int entry, int cpu) {
+    deviceRoute[entry] = cpu;
+    *(IRTENTRY((entry / DEVPERINT) + DISKINT, entry % DEVPERINT)) = cpu;
+}
+
+/*
+* Function: Is Waited On
+* Does a process wait on the device of the routing entry? For a 
+* terminal, either half counts.
+*/
+static int isWaitedOn(int entry) {
+    if(entry < ((TERMINT - NOSEM) * DEVPERINT)) {
+        return (semdTable[entry] < 0);
+    }
+    return ((semdTable[entry] < 0) || (semdTable[entry + DEVPERINT] < 0));
+}
+
+/*
+* Function: Initialize Routing
+* Programs the interrupt routing table at boot: the interval timer 
+* goes to processor 0, whose pseudo-clock handler also rebalances 
+* the routing, and so do the devices: processor 0 is the only one 
+* known to be up, and the rebalance spreads them over the others 
+* as they report in.
+*/
+void initRouting() {
+    int entry;
+    routeLock = NOLOCK;
+    *(IRTENTRY(INTERVALLINE, 0)) = 0;
+    for(entry = 0; entry < DEVENTRIES; entry++) {
+        deviceInterrupts[entry] = 0;
+        routeEntry(entry, 0);
+    }
+}
+
+/*
+* Function: Steer Device
+* Called when the current process blocks waiting for the device of 
+* the semaphore index: the completion is sent to this processor, 
+* whose run queue the process goes back to, so it is woken where its 
+* working set is warm.
+*/
+void steerDevice(int semIndex) {
+    int entry = DEVENTRY(semIndex);
+    spinLock(&routeLock);
+    if(deviceRoute[entry] != getPRID()) {
+        routeEntry(entry, getPRID());
+    }
+    spinUnlock(&routeLock);
+}
+
+/*
+* Function: Rebalance Routing
+* Called on every pseudo-clock tick. A device someone waits on stays 
+* with the processor the waiter was steered to, and its interrupts 
+* count towards that processor's load. The other devices, busiest 
+* first, each go to the processor that is up with the least load so 
+* far; every device adds one to the load, so the idle ones are spread 
+* as well. Then the counts are halved, so the rates follow recent 
+* traffic.
+*/
+static void rebalanceRouting() {
+    int load[NCPUS];
+    int placed[DEVENTRIES];
+    int entry;
+    int best;
+    int cpu;
+    int target;
+    for(cpu = 0; cpu < NCPUS; cpu++) {
+        load[cpu] = 0;
+    }
+    spinLock(&routeLock);
+    for(entry = 0; entry < DEVENTRIES; entry++) {
+        placed[entry] = isWaitedOn(entry);
+        if(placed[entry]) {
+            load[deviceRoute[entry]] += deviceInterrupts[entry] + 1;
+        }
+    }
+    while(TRUE) {
+        /* the busiest device not placed yet */
+        best = -1;
+        for(entry = 0; entry < DEVENTRIES; entry++) {
+            if(!placed[entry] && ((best == -1) || (deviceInterrupts[entry] > deviceInterrupts[best]))) {
+                best = entry;
+            }
+        }
+        if(best == -1) {
+            break;
+        }
+        /* the least loaded processor */
+        target = 0;
+        for(cpu = 1; cpu < NCPUS; cpu++) {
+            if(((onlineCpus & (1 << cpu)) != 0) && (load[cpu] < load[target])) {
+                target = cpu;
+            }
+        }
+        if(deviceRoute[best] != target) {
+            routeEntry(best, target);
+        }
+        load[target] += deviceInterrupts[best] + 1;
+        placed[best] = TRUE;
+    }
+    spinUnlock(&routeLock);
+    for(entry = 0; entry < DEVENTRIES; entry++) {
+        atomicAdd(&(deviceInterrupts[entry]), -(deviceInterrupts[entry] / 2));
+    }
+}
+
 /************************************************************************************************************************/
 /******************************************** INTERVAL TIMER HANDLER*****************************************************/
 /************************************************************************************************************************/
@@ -135,6 +270,7 @@ static void intervalTimerHandler(cpu_t startTime, cpu_t endTime) {
     /* get the index of the last device in the device 
     semaphore list - which is the interval timer */
     int *semaphore = &(semdTable[CLOCK]);
+    lockSemaphore(semaphore);
     /* reset the semaphore */
     (*semaphore) = 0;
     /* get all of the blocked devices*/
@@ -145,17 +281,20 @@ static void intervalTimerHandler(cpu_t startTime, cpu_t endTime) {
         STCK(endTime);
         if(p != NULL) {
             /* a process has been freed up */
-            insertProcQ(&(readyQueue), p);
+            makeReady(p);
             /* the elapsed time is the start minus the end */
             cpu_t elapsedTime = (endTime - startTime);
             /* handle the charging of time */
             (p->p_time) = (p->p_time) + elapsedTime;
             /* one less device waiting */
-            softBlockedCount--;
+            atomicAdd(&softBlockedCount, -1);
             /* get the next one */
             blocked = headBlocked(semaphore);
         }
     }
+    unlockSemaphore(semaphore);
+    /* spread the devices across the processors */
+    rebalanceRouting();
     /* exit the interrupt handler - from which this process had 
     come from */
     exitInterruptHandler(startTime);
@@ -169,7 +308,7 @@ static void intervalTimerHandler(cpu_t startTime, cpu_t endTime) {
 * psuedo-clock timer to signify a process' specific quantum is over. The interval timer handler 
 * will analyze the contents of the cause register to see what happened - i.e. what is the cause line
 * number for this particular interrupt. Based on the cause, if it is line number is 0, it is an 
-* inter-processor interrupt and handled with a kernel panic - since it is not supported in Kaya.
+* inter-processor interrupt, sent by a processor shooting down TLB entries.
 * If the line number is the processor local timer, the interrupt handler will then exit the 
 * interrupt handler by entering the exit handler - which will then get a new job from the scheduler. If
 * the interrupting line was the interal timer bus, then it will be passed to the interval timer handler 
@@ -182,7 +321,7 @@ static void intervalTimerHandler(cpu_t startTime, cpu_t endTime) {
 */
 void interruptHandler() {
     /* the old interrupt area */
-    state_PTR oldInterupt = (state_PTR) INTRUPTOLDAREA;
+    state_PTR oldInterupt = CPUAREA(INTRUPTOLDAREA);
     /* the device register */
     device_PTR devReg;
     /* the cause for the interrupt is stored in the cause register */
@@ -201,9 +340,12 @@ void interruptHandler() {
     int i = 0;
     /* what happened? */
     if ((cause & FIRST) != 0) {
-        /* the cause should not be 0 - since it is not supported 
-        in Kaya */
-        PANIC();
+        /* an inter-processor interrupt: another processor wants 
+        entries out of our TLB */
+        serviceShootdown();
+        /* acknowledge the message */
+        *(IPIINBOX) = 0;
+        exitInterruptHandler(startTime);
     } else if((cause & SECOND) != 0) {
         /* processor local timer */
         exitInterruptHandler(startTime);
@@ -240,6 +382,11 @@ void interruptHandler() {
         i = DEVPERINT * (lineNumber - NOSEM) + deviceNumber;
     }
     int *semaphore = &(semdTable[i]);
+    /* for the rebalancing */
+    atomicAdd(&(deviceInterrupts[DEVENTRY(i)]), 1);
+    /* the device's semaphore has a lock of its own, so interrupts 
+    from other devices are handled on other processors meanwhile */
+    lockSemaphore(semaphore);
     /* perform a V operation on the semaphore */
     (*semaphore)++;
     if((*semaphore) <= 0) {
@@ -248,24 +395,39 @@ void interruptHandler() {
         if (p != NULL) {
             /* implement the handshake */
             if(receive && (lineNumber == TERMINT)) {
-                p->p_state.s_v0 = devReg->t_recv_status;
+                p->p_state->s_v0 = devReg->t_recv_status;
                 /* the reception has been acknowledged */
                 devReg->t_recv_command = ACK;
             } else if(!receive && (lineNumber == TERMINT)) {
-                p->p_state.s_v0 = devReg->t_transm_status;
+                p->p_state->s_v0 = devReg->t_transm_status;
                 /* the transmission has been acknowledged */
                 devReg->t_transm_command = ACK;
             } else {
-                p->p_state.s_v0 = devReg->d_status;
+                p->p_state->s_v0 = devReg->d_status;
                 /* the command has been acknowledged */
                 devReg->d_command = ACK;
             }
             /* we have one less process wairing */
-            softBlockedCount--;
+            atomicAdd(&softBlockedCount, -1);
             /* insert into the ready queue */
-            insertProcQ(&(readyQueue), p);
+            makeReady(p);
+        }
+    } else {
+        /* nobody is waiting yet: the command was started ahead of its 
+        wait for io, so latch the status for it and acknowledge the 
+        device so it stops interrupting */
+        if(receive && (lineNumber == TERMINT)) {
+            deviceStatus[i] = devReg->t_recv_status;
+            devReg->t_recv_command = ACK;
+        } else if(!receive && (lineNumber == TERMINT)) {
+            deviceStatus[i] = devReg->t_transm_status;
+            devReg->t_transm_command = ACK;
+        } else {
+            deviceStatus[i] = devReg->d_status;
+            devReg->d_command = ACK;
         }
     }
+    unlockSemaphore(semaphore);
     /* exit the interrupt handler */
     exitInterruptHandler(startTime);
 }
@@ -50,6 +50,9 @@ typedef unsigned int devregtr;
 #define CLOCKLOOP 10
 #define MINCLOCKLOOP 3000
 
+#define RTPERIOD 100000 /* p9's real-time period, in microseconds */
+#define RTBUDGET 10000  /* and its budget in it */
+
 #define BADADDR 0xFFFFFFFF
 #define TERM0ADDR 0x10000250
 
@@ -87,10 +90,19 @@ SEMAPHORE term_mut = 1, /* for mutual exclusion on terminal */
     endp5 = 0,          /* to signal demise of p5 */
     endp8 = 0,          /* to signal demise of p8 */
     endcreate = 0,      /* for a p8 leaf to signal its creation */
-    blkp8 = 0;          /* to block p8 */
+    blkp8 = 0,          /* to block p8 */
+    synp9 = 0,          /* used to allow p9 and p9a to synchronize */
+    blkp9 = 0,          /* to block p9a */
+    endp9 = 0,          /* to signal demise of p9 */
+    blkp9b = 0,         /* to block p9b until its grandchild terminates it */
+    synp10 = 0,         /* for p10a to signal it is done with the mutex */
+    endp10 = 0;         /* to signal demise of p10 */
+
+mutex_t p10mut = {1, NOPID}; /* the mutex p10 and p10a contend for */
 
 state_t p2state, p3state, p4state, p5state, p6state, p7state, p8rootstate,
-    child1state, child2state, gchild1state, gchild2state, gchild3state, gchild4state;
+    child1state, child2state, gchild1state, gchild2state, gchild3state, gchild4state,
+    p9state, p9astate, p9bstate, p9cstate, p10state, p10astate;
 
 /* trap states for p5 */
 state_t pstat_n, mstat_n, sstat_n, pstat_o, mstat_o, sstat_o;
@@ -98,6 +110,10 @@ state_t pstat_n, mstat_n, sstat_n, pstat_o, mstat_o, sstat_o;
 int p1p2synch = 0; /* to check on p1/p2 synchronization */
 
 int p8inc;     /* p8's incarnation number */
+int p9apid;    /* p9a's process id, for p9 to signal and terminate it */
+int p9bpid;    /* p9b's process id, for its child p9c to terminate it */
+int p9cpid = NOPID; /* p9c's process id, set once p9b is blocked */
+int p10apid;   /* p10a's process id, to check it was handed the mutex */
 int p4inc = 1; /* p4 incarnation number */
 
 unsigned int p5Stack; /* so we can allocate new stack for 2nd p5 */
@@ -106,7 +122,8 @@ int creation = 0;           /* return code for SYSCALL invocation */
 memaddr *p5MemLocation = 0; /* To cause a p5 trap */
 
 void p2(), p3(), p4(), p5(), p5a(), p5b(), p6(), p7(), p7a(), p5prog(), p5mm();
-void p5sys(), p8root(), child1(), child2(), p8leaf();
+void p5sys(), p8root(), child1(), child2(), p8leaf(), p9(), p9a(), p9b(), p9c(), p10(),
+    p10a();
 
 /* a procedure to print on terminal 0 */
 void print(char *msg)
@@ -212,6 +229,36 @@ void test()
     gchild4state.s_pc = gchild4state.s_t9 = (memaddr)p8leaf;
     gchild4state.s_status = gchild4state.s_status | IEPBITON | CAUSEINTMASK;
 
+    STST(&p9state);
+    p9state.s_sp = gchild4state.s_sp - QPAGE;
+    p9state.s_pc = p9state.s_t9 = (memaddr)p9;
+    p9state.s_status = p9state.s_status | IEPBITON | CAUSEINTMASK;
+
+    STST(&p9astate);
+    p9astate.s_sp = p9state.s_sp - QPAGE;
+    p9astate.s_pc = p9astate.s_t9 = (memaddr)p9a;
+    p9astate.s_status = p9astate.s_status | IEPBITON | CAUSEINTMASK;
+
+    STST(&p9bstate);
+    p9bstate.s_sp = p9astate.s_sp - QPAGE;
+    p9bstate.s_pc = p9bstate.s_t9 = (memaddr)p9b;
+    p9bstate.s_status = p9bstate.s_status | IEPBITON | CAUSEINTMASK;
+
+    STST(&p9cstate);
+    p9cstate.s_sp = p9bstate.s_sp - QPAGE;
+    p9cstate.s_pc = p9cstate.s_t9 = (memaddr)p9c;
+    p9cstate.s_status = p9cstate.s_status | IEPBITON | CAUSEINTMASK;
+
+    STST(&p10state);
+    p10state.s_sp = p9cstate.s_sp - QPAGE;
+    p10state.s_pc = p10state.s_t9 = (memaddr)p10;
+    p10state.s_status = p10state.s_status | IEPBITON | CAUSEINTMASK;
+
+    STST(&p10astate);
+    p10astate.s_sp = p10state.s_sp - QPAGE;
+    p10astate.s_pc = p10astate.s_t9 = (memaddr)p10a;
+    p10astate.s_status = p10astate.s_status | IEPBITON | CAUSEINTMASK;
+
     /* create process p2 */
     SYSCALL(CREATETHREAD, (int)&p2state, 0, 0); /* start p2     */
 
@@ -259,6 +306,14 @@ void test()
         SYSCALL(PASSERN, (int)&endp8, 0, 0);
     }
 
+    SYSCALL(CREATETHREAD, (int)&p9state, 0, 0); /* start p9     */
+
+    SYSCALL(PASSERN, (int)&endp9, 0, 0); /* P(endp9)     */
+
+    SYSCALL(CREATETHREAD, (int)&p10state, 0, 0); /* start p10    */
+
+    SYSCALL(PASSERN, (int)&endp10, 0, 0); /* P(endp10)    */
+
     print("p1 finishes OK -- TTFN\n");
     *((memaddr *)BADADDR) = 0; /* terminate p1 */
 
@@ -632,3 +687,221 @@ void p8leaf()
 
     SYSCALL(PASSERN, (int)&blkp8, 0, 0);
 }
+
+/* p9 -- process id, affinity, priority and real-time SYS test process */
+void p9()
+{
+    int pid;
+    int i;
+
+    print("p9 starts\n");
+
+    /* test of SYS20 */
+    pid = SYSCALL(GETPID, 0, 0, 0);
+    if (pid == NOPID)
+        print("error: p9 has no pid\n");
+
+    /* test of SYS23 and SYS24 */
+    if (SYSCALL(GETAFFINITY, 0, 0, 0) != ALLCPUS)
+        print("error: p9 did not inherit p1's affinity\n");
+    if (SYSCALL(SETAFFINITY, 0, 0, 0) != FAILURE)
+        print("error: p9 may run on no processor\n");
+    if ((SYSCALL(SETAFFINITY, 1, 0, 0) != SUCCESS) || (SYSCALL(GETAFFINITY, 0, 0, 0) != 1))
+        print("error: p9 could not pin itself to processor 0\n");
+    SYSCALL(SETAFFINITY, ALLCPUS, 0, 0);
+
+    print("p9 - affinity OK\n");
+
+    /* test of SYS25 */
+    if (SYSCALL(SETPRIORITY, PRIOLEVELS, 0, 0) != FAILURE)
+        print("error: p9 set a priority there is not\n");
+    if (SYSCALL(SETPRIORITY, DEFAULTPRIO - 1, 0, 0) != FAILURE)
+        print("error: p9 rose above p1's priority\n");
+    if (SYSCALL(SETPRIORITY, PRIOLEVELS - 1, 0, 0) != SUCCESS)
+        print("error: p9 could not lower its priority\n");
+    if (SYSCALL(SETPRIORITY, DEFAULTPRIO, 0, 0) != SUCCESS)
+        print("error: p9 could not go back to p1's priority\n");
+
+    print("p9 - priority OK\n");
+
+    /* test of SYS26 and SYS27 */
+    if (SYSCALL(SETREALTIME, RTPERIOD, RTPERIOD + 1, 0) != FAILURE)
+        print("error: p9 admitted with a budget over its period\n");
+    if (SYSCALL(SETREALTIME, RTPERIOD, RTBUDGET, 0) != SUCCESS)
+        print("error: p9 not admitted as real-time\n");
+    if (SYSCALL(SETAFFINITY, ALLCPUS, 0, 0) != FAILURE)
+        print("error: real-time p9 left its processor\n");
+
+    /* run through a few periods */
+    for (i = 0; i < CLOCKLOOP; i++)
+        SYSCALL(WAITCLOCK, 0, 0, 0);
+
+    /* p9 sleeps through its periods, so its budget always fits */
+    if (SYSCALL(GETMISSES, 0, 0, 0) != 0)
+        print("error: p9 missed a deadline with budget to spare\n");
+    if (SYSCALL(SETREALTIME, 0, 0, 0) != SUCCESS)
+        print("error: p9 could not go back to best effort\n");
+    if (SYSCALL(SETAFFINITY, ALLCPUS, 0, 0) != SUCCESS)
+        print("error: p9 stayed pinned after real-time\n");
+
+    print("p9 - real-time OK\n");
+
+    /* test of SYS22 and SYS21 */
+    if (SYSCALL(SIGNALPID, pid, 0, 0) != FAILURE)
+        print("error: p9 woke itself\n");
+
+    SYSCALL(CREATETHREAD, (int)&p9astate, 0, 0); /* start p9a    */
+
+    SYSCALL(PASSERN, (int)&synp9, 0, 0); /* p9a knows its pid */
+
+    /* until p9a waits on blkp9 */
+    while (SYSCALL(SIGNALPID, p9apid, 0, 0) != SUCCESS)
+        ;
+
+    SYSCALL(PASSERN, (int)&synp9, 0, 0); /* p9a woke up    */
+
+    if (blkp9 != 0)
+        print("error: the signalled P was not undone\n");
+
+    /* give p9a the time to block again */
+    while (blkp9 == 0)
+        SYSCALL(WAITCLOCK, 0, 0, 0);
+
+    if (SYSCALL(TERMINATEPID, p9apid, 0, 0) != SUCCESS)
+        print("error: p9 could not terminate p9a\n");
+    if (SYSCALL(TERMINATEPID, p9apid, 0, 0) != FAILURE)
+        print("error: p9a terminated twice\n");
+    if (SYSCALL(SIGNALPID, p9apid, 0, 0) != FAILURE)
+        print("error: p9 signalled a terminated p9a\n");
+
+    /* test of SYS21 on an ancestor of the caller */
+    SYSCALL(CREATETHREAD, (int)&p9bstate, 0, 0); /* start p9b    */
+
+    /* until p9c has terminated p9b, which undoes p9b's P */
+    while ((p9cpid == NOPID) || (blkp9b != 0))
+        SYSCALL(WAITCLOCK, 0, 0, 0);
+
+    if (SYSCALL(TERMINATEPID, p9bpid, 0, 0) != FAILURE)
+        print("error: p9b survived its grandchild\n");
+    if (SYSCALL(TERMINATEPID, p9cpid, 0, 0) != FAILURE)
+        print("error: p9c survived terminating its parent\n");
+
+    print("p9 - pids OK\n");
+
+    SYSCALL(VERHOGEN, (int)&endp9, 0, 0); /* V(endp9)     */
+
+    SYSCALL(TERMINATETHREAD, 0, 0, 0); /* terminate p9 */
+
+    /* just did a SYS2, so should not get to this point */
+    print("error: p9 didn't terminate\n");
+    PANIC(); /* PANIC!           */
+}
+
+/* p9a -- waits for p9 to signal it, then to terminate it */
+void p9a()
+{
+    p9apid = SYSCALL(GETPID, 0, 0, 0);
+
+    SYSCALL(VERHOGEN, (int)&synp9, 0, 0); /* V(synp9)     */
+
+    if (SYSCALL(PASSERN, (int)&blkp9, 0, 0) != FAILURE)
+        print("error: p9a's wait was not cut short\n");
+
+    SYSCALL(VERHOGEN, (int)&synp9, 0, 0); /* V(synp9)     */
+
+    SYSCALL(PASSERN, (int)&blkp9, 0, 0); /* P(blkp9)     */
+
+    /* p9 terminated us while we waited */
+    print("error: p9a alive after TERMINATEPID\n");
+    PANIC();
+}
+
+/* p9b -- starts p9c, then waits for p9c to terminate it */
+void p9b()
+{
+    p9bpid = SYSCALL(GETPID, 0, 0, 0);
+
+    SYSCALL(CREATETHREAD, (int)&p9cstate, 0, 0); /* start p9c    */
+
+    SYSCALL(PASSERN, (int)&blkp9b, 0, 0); /* P(blkp9b)    */
+
+    /* p9c terminated us while we waited */
+    print("error: p9b alive after its child terminated it\n");
+    PANIC();
+}
+
+/* p9c -- terminates its parent p9b, and so itself */
+void p9c()
+{
+    /* until p9b waits on blkp9b */
+    while (blkp9b == 0)
+        SYSCALL(WAITCLOCK, 0, 0, 0);
+
+    p9cpid = SYSCALL(GETPID, 0, 0, 0);
+
+    SYSCALL(TERMINATEPID, p9bpid, 0, 0);
+
+    /* went with its parent, so should not get to this point */
+    print("error: p9c alive after terminating p9b\n");
+    PANIC();
+}
+
+/* p10 -- mutex SYS test process */
+void p10()
+{
+    int pid;
+
+    print("p10 starts\n");
+
+    pid = SYSCALL(GETPID, 0, 0, 0);
+
+    /* test of SYS29 on a mutex nobody holds */
+    if (SYSCALL(UNLOCKMUTEX, (int)&p10mut, 0, 0) != FAILURE)
+        print("error: p10 unlocked a mutex it does not hold\n");
+
+    /* test of SYS28 */
+    if ((SYSCALL(LOCKMUTEX, (int)&p10mut, 0, 0) != SUCCESS) || (p10mut.m_owner != pid))
+        print("error: p10 does not hold the mutex\n");
+
+    SYSCALL(CREATETHREAD, (int)&p10astate, 0, 0); /* start p10a   */
+
+    /* until p10a waits on the mutex */
+    while (p10mut.m_value == 0)
+        SYSCALL(WAITCLOCK, 0, 0, 0);
+
+    /* test of SYS29: the mutex goes to p10a */
+    if (SYSCALL(UNLOCKMUTEX, (int)&p10mut, 0, 0) != SUCCESS)
+        print("error: p10 could not unlock the mutex\n");
+
+    SYSCALL(PASSERN, (int)&synp10, 0, 0); /* P(synp10)    */
+
+    if (SYSCALL(UNLOCKMUTEX, (int)&p10mut, 0, 0) != FAILURE)
+        print("error: p10 unlocked the mutex twice\n");
+    if ((p10mut.m_value != 1) || (p10mut.m_owner != NOPID))
+        print("error: the mutex was left held\n");
+
+    print("p10 - mutex OK\n");
+
+    SYSCALL(VERHOGEN, (int)&endp10, 0, 0); /* V(endp10)    */
+
+    SYSCALL(TERMINATETHREAD, 0, 0, 0); /* terminate p10 */
+
+    /* just did a SYS2, so should not get to this point */
+    print("error: p10 didn't terminate\n");
+    PANIC(); /* PANIC!           */
+}
+
+/* p10a -- waits for the mutex p10 holds */
+void p10a()
+{
+    p10apid = SYSCALL(GETPID, 0, 0, 0);
+
+    if ((SYSCALL(LOCKMUTEX, (int)&p10mut, 0, 0) != SUCCESS) || (p10mut.m_owner != p10apid))
+        print("error: p10a was not handed the mutex\n");
+    if (SYSCALL(UNLOCKMUTEX, (int)&p10mut, 0, 0) != SUCCESS)
+        print("error: p10a could not unlock the mutex\n");
+
+    SYSCALL(VERHOGEN, (int)&synp10, 0, 0); /* V(synp10)    */
+
+    SYSCALL(TERMINATETHREAD, 0, 0, 0); /* terminate p10a */
+}
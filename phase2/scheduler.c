@@ -20,15 +20,484 @@
 #include "../e/initial.e"
 #include "../e/pcb.e"
 #include "../e/asl.e"
+#include "../e/spinlock.e"
+#include "../e/scheduler.e"
+#include "../e/exceptions.e"
 /* include the µmps2 library */
 #include "/usr/local/include/umps2/umps/libumps.e"
 
 /* GLOBAL VARIABLES */
-cpu_t startTOD;
-/* clock timers */
-cpu_t currentTOD;
+/* the processors each ASID has run on, whose TLBs may hold its entries */
+unsigned int asidCpus[MAXASID];
+/* the TLB shootdown in progress: its lock, the EntryHi to invalidate, 
+and the processors that have yet to do it */
+spinlock_t shootdownLock;
+unsigned int shootdownEntry;
+unsigned int shootdownPending;
+/* the process lock, held while the process tree changes */
+spinlock_t processLock;
 /* END OF GLOBAL VARIABLES */
 
+/************************************************************************************************************************/
+/************************************************* PROCESS LOCK *********************************************************/
+/************************************************************************************************************************/
+
+/*
+* Function: Lock Processes
+* Takes the process lock, which guards the process tree and the 
+* pid table: creating and terminating processes and the pid 
+* syscalls hold it. P and V, device waits and interrupts do not; 
+* they only take the locks of the semaphore and the run queues 
+* they touch, so they go on in parallel on the other processors. 
+* If the current process was terminated by another processor 
+* while we waited, it is reaped here and a new job is acquired.
+*/
+void lockProcesses() {
+    spinLock(&processLock);
+    if((currentProcess != NULL) && currentProcess->p_doomed) {
+        releaseMutexes(currentProcess);
+        freePcb(currentProcess);
+        atomicAdd(&processCount, -1);
+        currentProcess = NULL;
+        spinUnlock(&processLock);
+        invokeScheduler();
+    }
+}
+
+/*
+* Function: Unlock Processes
+* Releases the process lock.
+*/
+void unlockProcesses() {
+    spinUnlock(&processLock);
+}
+
+/*
+* Function: Reap Current
+* Frees the current process, which another processor terminated 
+* while it was running here, and acquires a new job. Called when 
+* the process would otherwise be blocked or dispatched, with no 
+* lock held.
+*/
+void reapCurrent() {
+    spinLock(&processLock);
+    releaseMutexes(currentProcess);
+    freePcb(currentProcess);
+    atomicAdd(&processCount, -1);
+    currentProcess = NULL;
+    spinUnlock(&processLock);
+    invokeScheduler();
+}
+
+/*
+* Function: Charge Current
+* Charges the current process for its time on the processor up 
+* to now. Called before the process is blocked or put back on a 
+* run queue, since another processor may pick it up from there 
+* at once.
+*/
+void chargeCurrent() {
+    STCK(currentTOD);
+    currentProcess->p_time = currentProcess->p_time + (currentTOD - startTOD);
+    /* and against its budget, if it is real-time */
+    if(currentProcess->p_period != 0) {
+        currentProcess->p_runtime = currentProcess->p_runtime + (currentTOD - startTOD);
+    }
+    startTOD = currentTOD;
+}
+
+/*
+* Function: TLB Invalidate
+* Invalidates the entry of this processor's TLB that matches the 
+* given EntryHi (page and ASID), if there is one, or the whole TLB.
+*/
+static void tlbInvalidate(unsigned int entryHI) {
+    unsigned int saved;
+    if(entryHI == ALLPAGES) {
+        TLBCLR();
+        return;
+    }
+    saved = getENTRYHI();
+    setENTRYHI(entryHI);
+    TLBP();
+    if((getINDEX() & PROBEFAIL) == 0) {
+        setENTRYLO(ALLOFF);
+        TLBWI();
+    }
+    setENTRYHI(saved);
+}
+
+/*
+* Function: Service Shootdown
+* Does this processor's part of the shootdown in progress, if it is 
+* one of its targets, and acknowledges it. Called on an inter-processor 
+* interrupt, and while waiting for the shootdown lock, so that two 
+* processors shooting down at once cannot wait on each other.
+*/
+void serviceShootdown() {
+    unsigned int self = (1 << getPRID());
+    if((shootdownPending & self) != 0) {
+        tlbInvalidate(shootdownEntry);
+        atomicClear(&shootdownPending, self);
+    }
+}
+
+/*
+* Function: TLB Shootdown
+* Called after a page table entry has been taken away from a process, 
+* before the frame is reused. The entry (its EntryHi, or ALLPAGES for 
+* the whole TLB) is invalidated here, and then on every other processor 
+* that has run the ASID (or on all of them, for ALLASIDS): they are sent 
+* an inter-processor interrupt and waited for. Runs with interrupts off, 
+* so it stays on one processor throughout. Called from outside the 
+* nucleus.
+*/
+void tlbShootdown(int asid, unsigned int entryHI) {
+    unsigned int status = getSTATUS();
+    unsigned int self;
+    unsigned int targets;
+    setSTATUS(status & ~IEc);
+    self = (1 << getPRID());
+    while(!CAS(&shootdownLock, NOLOCK, getPRID() + 1)) {
+        serviceShootdown();
+    }
+    tlbInvalidate(entryHI);
+    if(asid == ALLASIDS) {
+        targets = ALLCPUS & ~self;
+    } else {
+        targets = asidCpus[asid] & ~self;
+    }
+    if(targets != 0) {
+        shootdownEntry = entryHI;
+        shootdownPending = targets;
+        *(IPIOUTBOX) = (targets << IPIRECIPSHIFT) | IPISHOOTDOWN;
+        while(*((volatile unsigned int*) &shootdownPending) != 0) {
+            /* spin */
+        }
+    }
+    spinUnlock(&shootdownLock);
+    setSTATUS(status);
+}
+
+/*
+* Function: TLB Retire ASID
+* Called when an ASID is given up: its entries are shot down on every 
+* processor that ran it, and then it is counted as having run nowhere, 
+* so its next owner starts with no targets.
+*/
+void tlbRetireASID(int asid) {
+    tlbShootdown(asid, ALLPAGES);
+    asidCpus[asid] = 0;
+}
+
+/************************************************************************************************************************/
+/************************************************* RUN QUEUES ***********************************************************/
+/************************************************************************************************************************/
+
+/*
+* Function: Enqueue Ready
+* Puts a process at the tail of the queue of its level on a run 
+* queue, and marks the level as not empty; a real-time process goes 
+* on the real-time queue instead. A process that inherited a higher 
+* priority while it was away is queued at that priority. The caller 
+* holds the lock of the run queue.
+*/
+static void enqueueReady(percpu_t* cpu, pcb_PTR p) {
+    p->p_ready = TRUE;
+    if(p->p_period != 0) {
+        insertProcQ(&(cpu->c_rtQueue), p);
+        return;
+    }
+    if(p->p_level > p->p_boost) {
+        p->p_level = p->p_boost;
+    }
+    insertProcQ(&(cpu->c_readyQueues[p->p_level]), p);
+    cpu->c_readyMap |= (1 << p->p_level);
+    cpu->c_readyCount++;
+}
+
+/*
+* Function: Dequeue Ready
+* Takes a process off the queue of its level on a run queue, in 
+* constant time, and marks the level empty if it was the last one. 
+* The caller holds the lock of the run queue.
+*/
+static void dequeueReady(percpu_t* cpu, pcb_PTR p) {
+    p->p_ready = FALSE;
+    if(p->p_period != 0) {
+        unlinkProcQ(&(cpu->c_rtQueue), p);
+        return;
+    }
+    unlinkProcQ(&(cpu->c_readyQueues[p->p_level]), p);
+    if(emptyProcQ(cpu->c_readyQueues[p->p_level])) {
+        cpu->c_readyMap &= ~(1 << p->p_level);
+    }
+    cpu->c_readyCount--;
+}
+
+/*
+* Function: Highest Level
+* The highest priority level with a process ready, in constant time: 
+* the lowest bit set in the map is isolated, and its position found 
+* by halving the byte.
+*/
+static int highestLevel(unsigned int map) {
+    int level = 0;
+    map = map & (~map + 1);
+    if((map & 0xF0) != 0) {
+        level += 4;
+    }
+    if((map & 0xCC) != 0) {
+        level += 2;
+    }
+    if((map & 0xAA) != 0) {
+        level += 1;
+    }
+    return level;
+}
+
+/*
+* Function: Age Queues
+* Called on every dispatch. Every AGINGPERIOD dispatches, the oldest 
+* process of each level below the highest moves up a level, so a 
+* stream of high priority jobs cannot starve the others; it moves no 
+* more than AGINGLIMIT levels above its own priority, and is back at 
+* its own once it is dispatched. The caller holds the lock of the 
+* run queue.
+*/
+static void ageQueues(percpu_t* cpu) {
+    int level;
+    pcb_PTR p;
+    cpu->c_dispatches++;
+    if((cpu->c_dispatches % AGINGPERIOD) != 0) {
+        return;
+    }
+    for(level = 1; level < PRIOLEVELS; level++) {
+        if(emptyProcQ(cpu->c_readyQueues[level])) {
+            continue;
+        }
+        p = headProcQ(cpu->c_readyQueues[level]);
+        if(level > (EFFPRIO(p) - AGINGLIMIT)) {
+            dequeueReady(cpu, p);
+            p->p_level = level - 1;
+            enqueueReady(cpu, p);
+        }
+    }
+}
+
+/*
+* Function: Replenish
+* Starts a new period for a real-time process whose deadline has 
+* passed, with its whole budget. If it was runnable and still had 
+* budget left when the deadline passed, it wanted the processor and 
+* did not get its share in time, so the deadline is counted as 
+* missed; a process that was blocked, or had used up its budget, 
+* did not miss it.
+*/
+static void replenish(pcb_PTR p, int runnable) {
+    cpu_t now;
+    STCK(now);
+    if((now - p->p_deadline) < 0) {
+        return;
+    }
+    if(runnable && (p->p_runtime < p->p_budget)) {
+        p->p_misses++;
+    }
+    /* the period now is under way, skipping any that went by meanwhile */
+    p->p_deadline = p->p_deadline + (p->p_period * (((now - p->p_deadline) / p->p_period) + 1));
+    p->p_runtime = 0;
+}
+
+/*
+* Function: Pick Next
+* Chooses the next job from a run queue: the real-time process with 
+* the earliest deadline that has budget left, then the best-effort 
+* process of the highest priority ready, then a real-time process 
+* that has used up its budget, which runs in the background until 
+* its next period. A real-time process has its period renewed here 
+* if it has ended, so one that used up its budget comes back within 
+* a quantum of its new period. Returns NULL if the run queue is 
+* empty. The caller holds the lock of the run queue.
+*/
+static pcb_PTR pickNext(percpu_t* cpu) {
+    pcb_PTR p;
+    pcb_PTR earliest = NULL;
+    int last;
+    if(!emptyProcQ(cpu->c_rtQueue)) {
+        p = headProcQ(cpu->c_rtQueue);
+        do {
+            last = (p == cpu->c_rtQueue);
+            replenish(p, TRUE);
+            if((p->p_runtime < p->p_budget) &&
+                ((earliest == NULL) || ((p->p_deadline - earliest->p_deadline) < 0))) {
+                earliest = p;
+            }
+            p = p->p_next;
+        } while(!last);
+        if(earliest != NULL) {
+            return earliest;
+        }
+    }
+    if(cpu->c_readyMap != 0) {
+        return headProcQ(cpu->c_readyQueues[highestLevel(cpu->c_readyMap)]);
+    }
+    if(!emptyProcQ(cpu->c_rtQueue)) {
+        return headProcQ(cpu->c_rtQueue);
+    }
+    return NULL;
+}
+
+/*
+* Function: Make Ready
+* Puts a process on the run queue of the processor it last ran on, 
+* where its working set may still be warm; a process that never ran 
+* goes on the queue of the processor making it ready. Either must be 
+* in the process' affinity mask, or it goes to the first processor 
+* that is. Takes the lock of that run queue.
+*/
+void makeReady(pcb_PTR p) {
+    percpu_t* cpu;
+    int i;
+    if(p->p_cpu == NOCPU) {
+        p->p_cpu = getPRID();
+    }
+    if((p->p_affinity & (1 << p->p_cpu)) == 0) {
+        for(i = 0; (p->p_affinity & (1 << i)) == 0; i++) {
+            /* look further */
+        }
+        p->p_cpu = i;
+    }
+    cpu = &(cpus[p->p_cpu]);
+    /* a process is runnable up to now if it was preempted, not if it was blocked */
+    if(p->p_period != 0) {
+        replenish(p, (p == currentProcess));
+    }
+    spinLock(&(cpu->c_lock));
+    enqueueReady(cpu, p);
+    spinUnlock(&(cpu->c_lock));
+}
+
+/*
+* Function: Unready
+* Takes a process off the run queue it is on, in constant time. 
+* The process may be dispatched or stolen by another processor 
+* before we get the lock, so returns FALSE if it is no longer on 
+* that queue.
+*/
+int unready(pcb_PTR p) {
+    int cpu = p->p_cpu;
+    int found = FALSE;
+    if(cpu == NOCPU) {
+        return FALSE;
+    }
+    spinLock(&(cpus[cpu].c_lock));
+    if(p->p_ready && (p->p_cpu == cpu)) {
+        dequeueReady(&(cpus[cpu]), p);
+        found = TRUE;
+    }
+    spinUnlock(&(cpus[cpu].c_lock));
+    return found;
+}
+
+/*
+* Function: Boost Process
+* Has a process inherit the given priority, if it is higher than the 
+* one it has. A process waiting on a run queue moves up to the queue 
+* of that level at once; a blocked one is queued there when it is 
+* made ready, and a running one when it is next preempted. Called 
+* with the process lock held, so the process cannot be freed meanwhile.
+*/
+void boostProcess(pcb_PTR p, int priority) {
+    int cpu = p->p_cpu;
+    if(priority >= p->p_boost) {
+        return;
+    }
+    p->p_boost = priority;
+    if(cpu == NOCPU) {
+        return;
+    }
+    spinLock(&(cpus[cpu].c_lock));
+    if(p->p_ready && (p->p_cpu == cpu) && (p->p_period == 0) && (p->p_level > priority)) {
+        dequeueReady(&(cpus[cpu]), p);
+        enqueueReady(&(cpus[cpu]), p);
+    }
+    spinUnlock(&(cpus[cpu].c_lock));
+}
+
+/*
+* Function: Steal Work
+* Called when the run queue of this processor is empty: finds the 
+* longest run queue of the other processors and moves half of it 
+* (rounded up) over here, highest priority first, skipping the 
+* processes whose affinity keeps them off this processor. The two 
+* run queue locks are never held together: the processes come off 
+* the other queue under its lock, and go on ours under ours. 
+* Real-time processes are never stolen: they stay on the processor 
+* that admitted them. Returns FALSE if there was nothing to steal.
+*/
+static int stealWork() {
+    int self = getPRID();
+    int victim = NOCPU;
+    int i;
+    int level;
+    int count;
+    int last;
+    percpu_t* cpu;
+    pcb_PTR p;
+    pcb_PTR next;
+    pcb_PTR stolen = mkEmptyProcQ();
+    for(i = 0; i < NCPUS; i++) {
+        if((i != self) && (cpus[i].c_readyCount > 0) &&
+            ((victim == NOCPU) || (cpus[i].c_readyCount > cpus[victim].c_readyCount))) {
+            victim = i;
+        }
+    }
+    if(victim == NOCPU) {
+        return FALSE;
+    }
+    cpu = &(cpus[victim]);
+    spinLock(&(cpu->c_lock));
+    count = (cpu->c_readyCount + 1) / 2;
+    for(level = 0; (level < PRIOLEVELS) && (count > 0); level++) {
+        p = NULL;
+        if(!emptyProcQ(cpu->c_readyQueues[level])) {
+            p = headProcQ(cpu->c_readyQueues[level]);
+        }
+        /* from the head to the tail of the level, or as many as we want */
+        while((p != NULL) && (count > 0)) {
+            last = (p == cpu->c_readyQueues[level]);
+            next = p->p_next;
+            if((p->p_affinity & (1 << self)) != 0) {
+                dequeueReady(cpu, p);
+                p->p_cpu = self;
+                insertProcQ(&stolen, p);
+                count--;
+            }
+            p = (last ? NULL : next);
+        }
+    }
+    spinUnlock(&(cpu->c_lock));
+    if(emptyProcQ(stolen)) {
+        /* someone else got there first, or they are all pinned */
+        return FALSE;
+    }
+    while(!emptyProcQ(stolen)) {
+        makeReady(removeProcQ(&stolen));
+    }
+    return TRUE;
+}
+
+/*
+* Function: CPU Enter
+* Where the secondary processors start: they report in, so devices 
+* may be routed to them and processes pinned there, and join the 
+* scheduler. A processor the machine does not have never gets here.
+*/
+void cpuEnter() {
+    atomicSet(&onlineCpus, (1 << getPRID()));
+    invokeScheduler();
+}
+
 /************************************************************************************************************************/
 /*************************************************** SCHEDULER  *********************************************************/
 /************************************************************************************************************************/
@@ -42,11 +511,18 @@ cpu_t currentTOD;
 * but none are waiting on I/O the system will issue
 * a kernel panic. Otherwise, the scheduler will wait as a means 
 * of deadlock detection. Otherwise, jobs are scheduled using a 
-* simple round-robbin algorithm.
+* simple round-robbin algorithm. Every processor has a run queue of 
+* its own; when it runs dry, the processor steals half of the longest 
+* one. With several processors, the system is only deadlocked if no 
+* processor is running a job either.
 */
 void invokeScheduler() {
-    /* are there any ready jobs? */
-    if(emptyProcQ(readyQueue)) {
+    int i;
+    int running = 0;
+    percpu_t* self;
+    int asid;
+    /* are there any ready jobs, here or elsewhere? */
+    if((cpus[getPRID()].c_readyMap == 0) && emptyProcQ(cpus[getPRID()].c_rtQueue) && !stealWork()) {
         /* we have no running process */
         currentProcess = NULL;
         /* do we have any job to do? */
@@ -57,12 +533,21 @@ void invokeScheduler() {
         /* are we waiting on I/O? */
         if(processCount > 0) {
             /* do are we waiting for I/O? */
-            if(softBlockedCount == 0) {
+            /* is another processor running a job? */
+            for(i = 0; i < NCPUS; i++) {
+                if(cpus[i].c_current != NULL) {
+                    running++;
+                }
+            }
+            if((softBlockedCount == 0) && (running == 0)) {
                 /* not a job, not waiting for a job, 
                 and are not a job itself - kernel panic */ 
                 PANIC();
                 /* are we waiting for I/O? */
-            } else if(softBlockedCount > 0) {
+            } else {
+                /* the local timer brings us back to look at the 
+                ready queue, in case another processor readies a job */
+                setTIMER(QUANTUM);
                 /* enable interrupts for the next job */
                 setSTATUS(getSTATUS() | ALLOFF | INTERRUPTSON | IEc | IM);
                 /* wait */
@@ -71,11 +556,7 @@ void invokeScheduler() {
         }
     } else {
         /* simply ready the next job using round-robbin */
-        if (currentProcess != NULL) {
-            /* start the clock */
-            STCK(currentTOD);
-            currentProcess->p_time = currentProcess->p_time + (currentTOD - startTOD);
-        }
+        STCK(currentTOD);
         /* generate an interrupt when timer is up */
         if(currentTOD < QUANTUM) {
             /* our current job will be less than 
@@ -86,9 +567,36 @@ void invokeScheduler() {
             setTIMER(QUANTUM);
         }
         /* grab a job */
-        currentProcess = removeProcQ(&(readyQueue));
+        self = &(cpus[getPRID()]);
+        spinLock(&(self->c_lock));
+        currentProcess = pickNext(self);
+        if(currentProcess == NULL) {
+            /* stolen by another processor meanwhile */
+            spinUnlock(&(self->c_lock));
+            invokeScheduler();
+        }
+        dequeueReady(self, currentProcess);
+        /* aging is over once it runs */
+        currentProcess->p_level = EFFPRIO(currentProcess);
+        currentProcess->p_cpu = getPRID();
+        ageQueues(self);
+        spinUnlock(&(self->c_lock));
+        /* terminated by another processor while it was on its way here */
+        if(currentProcess->p_doomed) {
+            reapCurrent();
+        }
+        /* its TLB entries may be left here from now on */
+        asid = (currentProcess->p_state->s_asid & ENTRYHIASID) >> ASIDMASK;
+        if((asidCpus[asid] & (1 << getPRID())) == 0) {
+            atomicSet(&(asidCpus[asid]), (1 << getPRID()));
+        }
+        /* a real-time process is back here when its budget runs out */
+        if((currentProcess->p_period != 0) && (currentProcess->p_runtime < currentProcess->p_budget) &&
+            ((currentProcess->p_budget - currentProcess->p_runtime) < QUANTUM)) {
+            setTIMER(currentProcess->p_budget - currentProcess->p_runtime);
+        }
         STCK(startTOD);
         /* perform a context switch */
-        contextSwitch(&(currentProcess->p_state));
+        contextSwitch(currentProcess->p_state);
     }
 }
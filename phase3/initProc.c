@@ -1,6 +1,13 @@
 #include "../h/const.h"
 #include "../h/types.h"
+#include "../e/initProc.e"
 #include "../e/sysSupport.e"
+#include "../e/pager.e"
+#include "../e/swapManager.e"
+#include "../e/pcb.e"
+#include "../e/asl.e"
+#include "../e/heap.e"
+#include "../e/initial.e"
 /* include the µmps2 library */
 #include "/usr/local/include/umps2/umps/libumps.e"
 
@@ -8,16 +15,28 @@
 /* GLOBAL VARIABLES */
 pteOS_t kSegOS;
 pte_t kUseg3;
-swapPool_t pool[100];
+unsigned int kUseg3Backed;
 Tproc_t uProcesses[MAXUPROC];
 int next;
-int disk1Semaphore;
-int disk0Semaphore;
-int swapSemaphore;
+/* the disk, tape, swap pool and terminal locks are mutexes, so a holder 
+inherits the priority of the uprocs waiting on it */
+mutex_t diskSemaphores[DEVPERINT];
+/* a forked uproc shares its parent's tape, so the tapes are locked and
+their head positions are kept per tape */
+mutex_t tapeSemaphores[DEVPERINT];
+int tapePos[DEVPERINT];
+mutex_t swapSemaphore;
 int masterSemaphore; 
-int mutexSemaphores[MAXSEMALLOC];
+mutex_t mutexSemaphores[MAXSEMALLOC];
+/* the ASIDs no uproc is using, and how many uprocs are alive */
+HIDDEN int freeASIDs[MAXUPROC];
+HIDDEN int freeASIDCount;
+HIDDEN int liveUProcs;
 /* END OF GLOBAL VARIABLES */
 
+/* helpers used before they are defined */
+static void initASIDs();
+
 
 int debugger(int* i) {
 	i = 0;
@@ -32,54 +51,160 @@ int debugger2(int* i){
 
 /* will invalidate a page table entry given a frame number */
 void invalidateEntry(int frameNumber) {
-    pool[frameNumber].pageTableEntry->entryLO = ALLOFF | DIRTY;
+    /* a private page of one uproc is shot down by itself, on the 
+    processors that uproc ran on; anything else on every processor */
+    int asid = ALLASIDS;
+    unsigned int entryHI = ALLPAGES;
+    if((pool[frameNumber].image != NOIMAGE) || cowShared(frameNumber)) {
+        /* every uproc mapping the shared page loses it */
+        unshareFrame(frameNumber);
+    } else {
+        if(pool[frameNumber].segmentNumber != 3) {
+            asid = pool[frameNumber].ASID;
+            entryHI = pool[frameNumber].pageTableEntry->entryHI;
+        }
+        pool[frameNumber].pageTableEntry->entryLO = ALLOFF | DIRTY;
+        /* the owner gives up one frame of its resident set */
+        if(pool[frameNumber].segmentNumber != 3) {
+            uProcesses[pool[frameNumber].ASID - 1].Tp_resident--;
+        }
+    }
     pool[frameNumber].ASID = -1;
+    freeFrames++;
     pool[frameNumber].pageNumber = 0;
     pool[frameNumber].segmentNumber = 0;
     /* were done */
     pool[frameNumber].pageTableEntry = NULL;
-    /* deal with the TLB cache consistency */
-    /* by clearing the TLB */
-    TLBCLR();
+    /* deal with the TLB cache consistency, before the 
+    frame can be reused */
+    tlbShootdown(asid, entryHI);
+}
+
+/* reads a block of a tape into the buffer, wherever the head is */
+static void readBlock(int tape, int block, memaddr buffer) {
+	ownMutex(TRUE, &(tapeSemaphores[tape]));
+	tapeSeek(tape, block, buffer);
+	tapeOperation(tape, READBLK, buffer);
+	tapePos[tape]++;
+	ownMutex(FALSE, &(tapeSemaphores[tape]));
+}
+
+/*
+* Function: Fingerprint
+* Reads the text pages of an image off the tape, the first of them already
+* in the buffer, and hashes them all, so images that differ anywhere in
+* their text get different fingerprints but for a hash collision.
+*/
+static unsigned int fingerprint(int tape, int textPages, memaddr buffer) {
+	unsigned int* word = (unsigned int*) buffer;
+	unsigned int hash = FNVOFFSET;
+	int block;
+	int i;
+	for(block = 0; block < textPages; block++) {
+		if(block > 0) {
+			readBlock(tape, block, buffer);
+		}
+		for(i = 0; i < (PAGESIZE / WORDLEN); i++) {
+			hash = (hash ^ word[i]) * FNVPRIME;
+		}
+	}
+	/* 0 marks a free image slot */
+	if(hash == 0) {
+		hash = FNVOFFSET;
+	}
+	return hash;
+}
+
+/*
+* Function: Same Text
+* Rules out a hash collision before a uproc shares an image: compares the
+* text on our tape with the text on the image's, block by block, through
+* our tape buffer and a page borrowed from the heap. Different when there
+* is no page to borrow, since the uproc then simply runs its own copy.
+*/
+static int sameText(int tape, int imageTape, int textPages, memaddr buffer) {
+	memaddr other;
+	unsigned int* ours = (unsigned int*) buffer;
+	unsigned int* theirs;
+	int same = TRUE;
+	int block;
+	int i;
+	/* a tape is the same as itself */
+	if(tape == imageTape) {
+		return TRUE;
+	}
+	other = allocPages(0);
+	if(other == NOPAGE) {
+		return FALSE;
+	}
+	theirs = (unsigned int*) other;
+	for(block = 0; (block < textPages) && same; block++) {
+		readBlock(tape, block, buffer);
+		readBlock(imageTape, block, other);
+		for(i = 0; (i < (PAGESIZE / WORDLEN)) && same; i++) {
+			same = (ours[i] == theirs[i]);
+		}
+	}
+	freePages(other);
+	return same;
 }
 
-/* gets the ball rolling */
+/*
+* Function: Initialize UProc
+* Gets the ball rolling. Only the first block of the tape is read here: it
+* holds the a.out header, which gives the extents of .text and .data. The
+* tape blocks are mapped one to one onto the kUseg2 pages, so the pager
+* brings each page of the image in from the tape the first time it is
+* touched, and .bss and the stack are zero-filled. The uproc starts running
+* without waiting for the rest of its image.
+*/
 void initUProc() {
 
 	int asid = extractASID();
 	int asidIndex = asid - 1;
-	/* set up the disk */
-	device_PTR diskDevice = (device_PTR) DISKDEV;
-	/* set up the tape */
-	device_PTR tapeDevice = (device_PTR) TAPEDEV + ((asidIndex) * DEVREGSIZE);
+	int tape = uProcesses[asidIndex].Tp_tape;
 	/* set up a memory buffer */
-	int memoryBuffer = BUFFER + (asidIndex * PAGESIZE);
+	int memoryBuffer = TAPEBUFFER(asid);
+	memaddr* header = (memaddr*) memoryBuffer;
+	int textPages;
+	unsigned int hash;
+	int image;
+	int imageTape;
 
 	/* set up the exception state vectors for the sys-5 pass up 
 	or die helper method */
 	initializeExceptionsStateVector();
-	int pageNumber = 0;
-	/* read until we reach the end of line character or the 
-	end of tape marker */
-	int diskInformation[DISKPARAMS];
-	while((tapeDevice->d_data1 != EOF) && (tapeDevice->d_data1 != EOT)) {
-		/* while there are things to do... */
-		tapeDevice->d_data0 = memoryBuffer;
-		tapeDevice->d_command = READBLK;
-		/* set up the parameters for a disk 
-		operation */
-		diskInformation[SECTOR] = asidIndex;
-		diskInformation[CYLINDER] = pageNumber;
-		diskInformation[HEAD] = EMPTY;
-		diskInformation[DISKNUM] = EMPTY;
-		diskInformation[PAGELOCATION] = memoryBuffer;
-		diskInformation[READWRITE] = WRITEBLK;
-		/* perform a disk I/O now that we have all of the 
-		information we need */
-		diskOperation(diskInformation, &(disk0Semaphore), diskDevice);
-		/* keep track of the pages */
-		pageNumber++;
+	/* read the a.out header */
+	ownMutex(TRUE, &(tapeSemaphores[tape]));
+	tapeOperation(tape, READBLK, memoryBuffer);
+	tapePos[tape] = 1;
+	ownMutex(FALSE, &(tapeSemaphores[tape]));
+	/* .data is the last part of the image on the tape */
+	uProcesses[asidIndex].Tp_tapeBlocks = PAGEROUND(header[AOUTDATAOFFSET] + header[AOUTDATAFILESZ]) / PAGESIZE;
+	/* the last page of kUseg2 is the stack */
+	if(uProcesses[asidIndex].Tp_tapeBlocks >= KUSEGPTESIZE) {
+		terminateUProcess();
+	}
+	/* uprocs whose tapes hold the same text run the same image, and share 
+	the read-only pages in front of .data; the hash finds a likely match, 
+	and the tapes are compared before the image is shared */
+	textPages = header[AOUTDATAOFFSET] / PAGESIZE;
+	hash = fingerprint(tape, textPages, memoryBuffer);
+	ownMutex(TRUE, &(swapSemaphore));
+	image = findImage(hash, textPages, &imageTape);
+	ownMutex(FALSE, &(swapSemaphore));
+	if((image != NOIMAGE) && (!sameText(tape, imageTape, textPages, memoryBuffer))) {
+		ownMutex(TRUE, &(swapSemaphore));
+		dropImage(image);
+		ownMutex(FALSE, &(swapSemaphore));
+		image = NOIMAGE;
 	}
+	if(image == NOIMAGE) {
+		ownMutex(TRUE, &(swapSemaphore));
+		image = registerImage(hash, textPages, tape);
+		ownMutex(FALSE, &(swapSemaphore));
+	}
+	uProcesses[asidIndex].Tp_image = image;
 
 	/* prepare a new processor state */
 	state_PTR processorState = prepareProcessorState(FALSE, 0);
@@ -87,6 +212,18 @@ void initUProc() {
 	contextSwitch(processorState);
 }
 
+/*
+* Function: Forked UProc
+* Where a uproc made by FORK starts. Its pages and its user state were
+* set up by the parent; it only needs its own trap vectors before it
+* returns from the FORK with 0.
+*/
+void forkedUProc() {
+	int asid = extractASID();
+	initializeExceptionsStateVector();
+	contextSwitch(&(uProcesses[asid - 1].Told_trap[SYSTRAP]));
+}
+
 /* prepare a new processor state */
 state_PTR prepareProcessorState(int flag, int* index) {
 	/* preparing a processor state appropriate for the 
@@ -123,19 +260,29 @@ void test() {
 	/* some variables for indexing */
 	int i;
 	int j;
+	int tape;
+	int booted = 0;
+	/* the installed tapes, terminals and printers */
+	devregarea_PTR devReg = (devregarea_PTR) RAMBASEADDR;
+	unsigned int tapes = devReg->inst_dev[TAPEINT - NOSEM];
+	unsigned int terminals = devReg->inst_dev[TERMINT - NOSEM];
+	unsigned int printers = devReg->inst_dev[PRNTINT - NOSEM];
 
-	/* initalize the swap pool */
-	for(i = 0; i < SWAPSIZE; i++) {
-		pool[i].pageTableEntry = NULL;
-		pool[i].segmentNumber = 0;
-		pool[i].pageNumber = 0;
-		/* -1 signifies */
-		pool[i].ASID = -1;
-	}
+	/* a pcb_t and a semaphore for every uproc besides this process; the
+	kernel heap is what actually bounds them */
+	setPcbLimit(MAXUPROC + 1);
+	setSemdLimit(MAXUPROC + 1);
+	/* size and initalize the swap pool from the installed RAM */
+	initSwapPool();
+	/* lay out the backing store */
+	initSwapSpace();
+	/* every ASID is free */
+	initASIDs();
 	debugger(2);
 	/* initialize the semaphores */
 	for(i = 0; i < MAXSEMALLOC; i++){
-		mutexSemaphores[i] = 1;
+		mutexSemaphores[i].m_value = 1;
+		mutexSemaphores[i].m_owner = NOPID;
 	}
 	debugger(3);
 
@@ -147,17 +294,31 @@ void test() {
 		kSegOS.pteTable[i].entryLO = ((PADDRBASE + i) << VPNMASK) | VALID | DIRTY | GLOBAL;
 	} 
 	masterSemaphore = 0;
-	disk1Semaphore = 1;
-	disk0Semaphore = 1;
-	swapSemaphore = 1;
+	kUseg3Backed = 0;
+	for(i = 0; i < DEVPERINT; i++) {
+		diskSemaphores[i].m_value = 1;
+		diskSemaphores[i].m_owner = NOPID;
+		tapeSemaphores[i].m_value = 1;
+		tapeSemaphores[i].m_owner = NOPID;
+		tapePos[i] = 0;
+	}
+	swapSemaphore.m_value = 1;
+	swapSemaphore.m_owner = NOPID;
 	debugger(4);
 	state_t processorState;
 	/* add a new processor state, per the student guide */
 	/* initialize the header */
 	kSegOS.header = MAGICNO << PGTBLHEADERWORD | KSEGOSPTESIZE;
-	for(i = 1; i < MAXUPROC + 1; i++) {
+	/* one uproc per installed tape */
+	for(tape = 0; tape < TAPEUPROCS; tape++) {
+		if((tapes & (FIRST << tape)) == 0) {
+			continue;
+		}
 		/* get the ith uProc */
-		/* Tproc_t userProc = uProcesses[i - 1] */
+		i = allocASID();
+		if(i == NOASID) {
+			PANIC();
+		}
 		/* initialize the header */
 		uProcesses[i - 1].Tp_pte.header = ((MAGICNO << PGTBLHEADERWORD) | KUSEGPTESIZE);
 		debugger(7);
@@ -168,7 +329,7 @@ void test() {
 			uProcesses[i - 1].Tp_pte.pteTable[j].entryLO = ALLOFF | DIRTY;
 		}
 		/* get the address of ith entry the segment table */
-		segt_PTR segmentTable = (segt_PTR) SEGSTART + (i * SEGWIDTH);
+		segt_PTR segmentTable = (segt_PTR) (SEGSTART + (i * SEGWIDTH));
 		/* point to the kSegOS segment */
 		segmentTable->kUseg2 = (&(uProcesses[i - 1].Tp_pte));
 		segmentTable->kSegOS = (&(kSegOS));
@@ -180,17 +341,37 @@ void test() {
 		processorState.s_t9 = (memaddr) initUProc;
 		processorState.s_pc = (memaddr) initUProc;
 		processorState.s_asid = (i << ASIDMASK);
-		processorState.s_sp = ((ROMPAGESTART + OSAREA) - (64 * PAGESIZE)) - (((TRAPTYPES-1) * PAGESIZE * (i-1)) + (PAGESIZE * TLBTRAP));
+		processorState.s_sp = UPROCSTACK(i, PROGTRAP);
 		debugger(9);
 		/* set the semaphore */
 		uProcesses[i - 1].Tp_sem = 0;
+		/* nothing is on the backing store until the pager puts it there */
+		uProcesses[i - 1].Tp_backed = 0;
+		uProcesses[i - 1].diskAddr = NOSLOT;
+		/* the loader reads the image extents from the tape */
+		uProcesses[i - 1].Tp_tapeBlocks = 0;
+		uProcesses[i - 1].Tp_tape = tape;
+		uProcesses[i - 1].Tp_image = NOIMAGE;
+		/* the uproc talks to the terminal and printer next to its tape */
+		uProcesses[i - 1].Tp_terminal = ((terminals & (FIRST << tape)) != 0) ? tape : NODEVICE;
+		uProcesses[i - 1].Tp_printer = ((printers & (FIRST << tape)) != 0) ? tape : NODEVICE;
+		/* nothing resident and no faults yet */
+		uProcesses[i - 1].Tp_resident = 0;
+		uProcesses[i - 1].Tp_hand = 0;
+		uProcesses[i - 1].Tp_faults = 0;
+		uProcesses[i - 1].Tp_suspended = FALSE;
+		/* the group of backing-store slots for the uproc's pages */
+		if(reserveSwapGroup(i) != SUCCESS) {
+			PANIC();
+		}
 		int status = SYSCALL(CREATEPROCESS, (int) &(processorState), EMPTY, EMPTY);
 		if(status != SUCCESS) {
 			SYSCALL(TERMINATEPROCESS, EMPTY, EMPTY, EMPTY);
 		}
+		booted++;
 	}
 	debugger2(5);
-	for(i = 0; i < MAXUPROC; i++) {
+	for(i = 0; i < booted; i++) {
         debugger2(i);
 		SYSCALL(PASSEREN, (int) &(masterSemaphore), EMPTY, EMPTY);
 	}
@@ -199,6 +380,77 @@ void test() {
 	SYSCALL(TERMINATEPROCESS, EMPTY, EMPTY, EMPTY);
 }
 
+/*
+* Function: Initialize ASIDs
+* Puts every uproc ASID on the free list, lowest on top.
+*/
+static void initASIDs() {
+	int i;
+	freeASIDCount = 0;
+	for(i = MAXUPROC; i > 0; i--) {
+		freeASIDs[freeASIDCount] = i;
+		freeASIDCount++;
+		uProcesses[i - 1].diskAddr = NOSLOT;
+		uProcesses[i - 1].Tp_image = NOIMAGE;
+		uProcesses[i - 1].Tp_buffer = NOPAGE;
+		uProcesses[i - 1].Tp_stacks = NOPAGE;
+	}
+	liveUProcs = 0;
+}
+
+/*
+* Function: Allocate ASID
+* Takes an ASID off the free list and gives the uproc its support pages
+* from the kernel heap. Returns NOASID when every ASID is taken or the heap
+* is full. Called with the swap pool semaphore held, or at boot.
+*/
+int allocASID() {
+	int asid;
+	memaddr buffer;
+	memaddr stacks;
+	if(freeASIDCount == 0) {
+		return NOASID;
+	}
+	buffer = allocPages(0);
+	if(buffer == NOPAGE) {
+		return NOASID;
+	}
+	stacks = allocPages(STACKORDER);
+	if(stacks == NOPAGE) {
+		freePages(buffer);
+		return NOASID;
+	}
+	freeASIDCount--;
+	asid = freeASIDs[freeASIDCount];
+	uProcesses[asid - 1].Tp_buffer = buffer;
+	uProcesses[asid - 1].Tp_stacks = stacks;
+	liveUProcs++;
+	resizeResidentQuota(liveUProcs);
+	return asid;
+}
+
+/*
+* Function: Free ASID
+* Recycles the ASID and the tape buffer of a terminated uproc. The TLB
+* is cleared on every processor so no entry of the old uproc survives
+* into the next one. Returns the block of its stacks, which the caller
+* frees: a uproc terminating itself is still running on them, so it
+* records them in its pcb_t for the nucleus to free with it.
+* Called with the swap pool semaphore held.
+*/
+memaddr freeASID(int asid) {
+	memaddr stacks = uProcesses[asid - 1].Tp_stacks;
+	freePages(uProcesses[asid - 1].Tp_buffer);
+	uProcesses[asid - 1].Tp_buffer = NOPAGE;
+	uProcesses[asid - 1].Tp_stacks = NOPAGE;
+	freeASIDs[freeASIDCount] = asid;
+	freeASIDCount++;
+	liveUProcs--;
+	resizeResidentQuota(liveUProcs);
+	tlbRetireASID(asid);
+	return stacks;
+}
+
 /* 
 * Function: extract ASID
 * Extracts the entryLO register. The register will have the bits 0-5 to be unused,
@@ -216,27 +468,32 @@ int extractASID() {
 
 /* sets up pass up or die stuff */
 static void initializeExceptionsStateVector() {
-	/* need a new state */
-	state_PTR state = NULL;
 	int i;
+	int asid = extractASID();
 	/* for each trap type */
 	for(i = 0; i < TRAPTYPES; i++) {
 		/* get the state by the asid */
-		state_PTR state = &(uProcesses[extractASID() -1].Tnew_trap[i]);
+		state_PTR state = &(uProcesses[asid - 1].Tnew_trap[i]);
+		/* the handlers run in kernel mode with interrupts on and 
+		the uproc's asid */
+		state->s_status = ALLOFF | IEc | IM | TE;
+		state->s_asid = getENTRYHI();
 		if(i == TLBTRAP){
-			/* TODO: set up the proper exception handler */
-			state->s_t9 = NULL;
-			state->s_pc = NULL;
+			/* the pager has a stack page of its own */
+			state->s_t9 = (memaddr) pager;
+			state->s_pc = (memaddr) pager;
+			state->s_sp = UPROCSTACK(asid, TLBTRAP);
 		} else if(i == PROGTRAP) {
-			/* TODO: set up the proper exception handler */
-			state->s_t9 = NULL;
-			state->s_pc = NULL;
-		} else if(i == TLBTRAP) {
-			/* TODO: set up the proper exception handler */
-			state->s_t9 = NULL;
-			state->s_pc = NULL;
+			/* program traps share the sys stack page */
+			state->s_t9 = (memaddr) progTrapHandler;
+			state->s_pc = (memaddr) progTrapHandler;
+			state->s_sp = UPROCSTACK(asid, PROGTRAP);
+		} else if(i == SYSTRAP) {
+			state->s_t9 = (memaddr) uSyscallHandler;
+			state->s_pc = (memaddr) uSyscallHandler;
+			state->s_sp = UPROCSTACK(asid, PROGTRAP);
 		}
-		SYSCALL(SPECTRAPVEC, i, (int) &(uProcesses[extractASID() - 1].Told_trap[i]), (int) state);
+		SYSCALL(SPECTRAPVEC, i, (int) &(uProcesses[asid - 1].Told_trap[i]), (int) state);
 	}
 }
 
@@ -4,122 +4,889 @@
 #include "../e/exceptions.e"
 #include "../e/initProc.e"
 #include "../e/sysSupport.e"
+#include "../e/pager.e"
+#include "../e/swapManager.e"
+#include "../e/heap.e"
+#include "../e/initial.e"
 /* include the µmps2 library */
 #include "/usr/local/include/umps2/umps/libumps.e"
 
+/* helpers used before they are defined */
+static int asidCount(asidset_t set);
+static void asidClear(asidset_t* set);
+
+/* GLOBAL VARIABLES */
+/* the frame table, one entry per swap pool frame */
+swapPool_t* pool;
+/* the number of frames in the swap pool */
+int swapPoolSize;
+/* the address of the first swap pool frame */
+memaddr swapPoolStart;
+/* the number of unoccupied frames */
+int freeFrames;
+/* the most frames a single uproc may hold */
+int residentQuota;
+/* the uproc currently held back by the load controller, 0 if none */
+HIDDEN int suspendedASID;
+/* the current page fault frequency window */
+HIDDEN cpu_t windowStart;
+HIDDEN int windowFaults;
+/* the images whose text pages are shared */
+HIDDEN image_t images[MAXUPROC];
+/* the faults waiting for any frame to settle, when all of them were busy */
+HIDDEN int frameWaiters;
+HIDDEN int frameFreeSem;
+/* END OF GLOBAL VARIABLES */
+
 void progTrapHandler() {
     terminateUProcess();
 }
 
+/*
+* Function: Initialize Swap Pool
+* Sizes the swap pool from the installed RAM. The frames live between the
+* end of the kernel heap and the nucleus stacks at RAMTOP; the support
+* pages of the uprocs come from the heap. The frame table comes first, so
+* its size always matches the number of frames it describes.
+*/
+void initSwapPool() {
+    int i;
+    /* the device register */
+    devregarea_PTR bus = (devregarea_PTR) RAMBASEADDR;
+    memaddr RAMTOP = bus->rambase + bus->ramsize;
+    /* the region left over for the frame table and the frames */
+    memaddr poolBase = heapEnd();
+    memaddr poolTop = RAMTOP - (KERNELSTACKPAGES * PAGESIZE);
+    int pages = (poolTop - poolBase) / PAGESIZE;
+    /* every frame costs a page plus its frame table entry */
+    swapPoolSize = (pages * PAGESIZE) / (PAGESIZE + sizeof(swapPool_t));
+    int tablePages = ((swapPoolSize * sizeof(swapPool_t)) + PAGESIZE - 1) / PAGESIZE;
+    if((swapPoolSize + tablePages) > pages) {
+        swapPoolSize--;
+    }
+    /* too little RAM to run the support level */
+    if(swapPoolSize < MINSWAPSIZE) {
+        PANIC();
+    }
+    pool = (swapPool_t*) poolBase;
+    swapPoolStart = poolBase + (tablePages * PAGESIZE);
+    freeFrames = swapPoolSize;
+    /* a uproc may hold up to twice its fair share of the pool */
+    resizeResidentQuota(TAPEUPROCS);
+    suspendedASID = 0;
+    frameWaiters = 0;
+    frameFreeSem = 0;
+    windowFaults = 0;
+    STCK(windowStart);
+    /* every frame starts out unoccupied */
+    for(i = 0; i < swapPoolSize; i++) {
+        pool[i].pageTableEntry = NULL;
+        pool[i].segmentNumber = 0;
+        pool[i].pageNumber = 0;
+        /* -1 signifies an empty frame */
+        pool[i].ASID = -1;
+        pool[i].image = NOIMAGE;
+        pool[i].refCount = 0;
+        asidClear(&(pool[i].sharers));
+        pool[i].busy = FALSE;
+        pool[i].victimASID = -1;
+        asidClear(&(pool[i].victimSharers));
+        pool[i].waiters = 0;
+        pool[i].frameSem = 0;
+    }
+    for(i = 0; i < MAXUPROC; i++) {
+        images[i].fingerprint = 0;
+        images[i].users = 0;
+    }
+}
+
+/*
+* Function: Resize Resident Quota
+* A uproc may hold up to twice its fair share of the pool, so the quota
+* follows the number of uprocs alive.
+*/
+void resizeResidentQuota(int uprocs) {
+    residentQuota = MAX(MINRESIDENT, (2 * swapPoolSize) / MAX(uprocs, 1));
+}
 
-/* just returns an increment on the last frame mod to create an incremental choice */
-static int next() {
+/* just returns an increment on the last frame mod to create an incremental choice, 
+skipping the frames that are in the middle of a page-in; -1 if one sweep finds 
+them all busy, since they are only settled by pagers that need the swap pool 
+semaphore we hold */
+static int nextFrame() {
     static int lastFrame = 0;
-    if (!lastFrame < SWAPSIZE) {
-        lastFrame = 0;
+    int i;
+    for(i = 0; i < swapPoolSize; i++) {
+        lastFrame = (lastFrame + 1) % swapPoolSize;
+        if(!pool[lastFrame].busy) {
+            return lastFrame;
+        }
+    }
+    return -1;
+}
+
+/*
+* Function: Unpin Frame
+* Marks a frame as no longer busy and lets the faults waiting on it, 
+* and the faults that found every frame busy, retry. Called with the 
+* swap pool semaphore held.
+*/
+static void unpinFrame(int frameNumber) {
+    pool[frameNumber].busy = FALSE;
+    while(pool[frameNumber].waiters > 0) {
+        pool[frameNumber].waiters--;
+        mutex(FALSE, &(pool[frameNumber].frameSem));
+    }
+    while(frameWaiters > 0) {
+        frameWaiters--;
+        mutex(FALSE, &(frameFreeSem));
+    }
+}
+
+/*
+* Function: Pick Frame
+* Chooses the frame a faulting uproc will fill. A uproc that already holds
+* its quota of frames replaces locally, round robin over its own frames, so
+* it cannot evict anyone else's working set. Otherwise an empty frame is
+* used if there is one, then a frame held by a suspended uproc, and only
+* then the global round robin victim. Returns -1 if every frame is busy.
+*/
+static int pickFrame(int ASID, int segmentNumber) {
+    int i;
+    int frameNumber;
+    Tproc_PTR uproc = &(uProcesses[ASID - 1]);
+    /* over quota - local replacement */
+    if((segmentNumber != 3) && (uproc->Tp_resident >= residentQuota)) {
+        for(i = 1; i <= swapPoolSize; i++) {
+            frameNumber = (uproc->Tp_hand + i) % swapPoolSize;
+            if((pool[frameNumber].ASID == ASID) && (pool[frameNumber].segmentNumber != 3) &&
+                (!pool[frameNumber].busy)) {
+                uproc->Tp_hand = frameNumber;
+                return frameNumber;
+            }
+        }
+    }
+    /* an empty frame costs nobody anything */
+    if(freeFrames > 0) {
+        for(i = 0; i < swapPoolSize; i++) {
+            if(pool[i].ASID == -1) {
+                return i;
+            }
+        }
+    }
+    /* a suspended uproc is not using its working set */
+    if(suspendedASID != 0) {
+        for(i = 0; i < swapPoolSize; i++) {
+            if((pool[i].ASID == suspendedASID) && (pool[i].segmentNumber != 3) && (!pool[i].busy)) {
+                return i;
+            }
+        }
+    }
+    return nextFrame();
+}
+
+/*
+* Function: Count Fault
+* The load controller. Page faults are counted per uproc over a window of
+* one pseudo-clock tick. When the total across all uprocs goes over
+* THRASHFAULTS, the uproc that faulted the most in the window is marked
+* to be suspended on its next fault, so the rest can keep their working
+* sets instead of the whole system thrashing. One uproc is held back at
+* a time. Called with the swap pool semaphore held.
+*/
+static void countFault(int ASID) {
+    int i;
+    int worst;
+    cpu_t now;
+    STCK(now);
+    /* start a new window */
+    if((now - windowStart) >= PFFWINDOW) {
+        for(i = 0; i < MAXUPROC; i++) {
+            uProcesses[i].Tp_faults = 0;
+        }
+        windowFaults = 0;
+        windowStart = now;
+    }
+    uProcesses[ASID - 1].Tp_faults++;
+    windowFaults++;
+    /* are we thrashing? */
+    if((windowFaults > THRASHFAULTS) && (suspendedASID == 0)) {
+        /* find the worst offender */
+        worst = ASID;
+        for(i = 0; i < MAXUPROC; i++) {
+            if(uProcesses[i].Tp_faults > uProcesses[worst - 1].Tp_faults) {
+                worst = i + 1;
+            }
+        }
+        /* holding back the only uproc that faults helps no one */
+        if(uProcesses[worst - 1].Tp_faults < windowFaults) {
+            uProcesses[worst - 1].Tp_suspended = TRUE;
+            suspendedASID = worst;
+        }
+    }
+}
+
+/*
+* Function: Release UProc Load
+* Clears the load control state of a terminating uproc, so a suspension
+* that never got to run does not block the controller. Called with the
+* swap pool semaphore held.
+*/
+void releaseUProcLoad(int ASID) {
+    uProcesses[ASID - 1].Tp_faults = 0;
+    uProcesses[ASID - 1].Tp_suspended = FALSE;
+    if(suspendedASID == ASID) {
+        suspendedASID = 0;
+    }
+}
+
+/* is the frame shared copy on write? */
+int cowShared(int frameNumber) {
+    return (asidCount(pool[frameNumber].sharers) != 0);
+}
+
+/* how many uprocs are in a set */
+static int asidCount(asidset_t set) {
+    int i;
+    int count = 0;
+    for(i = 1; i < MAXASID; i++) {
+        if(ASIDIN(set, i)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/* empties a set of uprocs */
+static void asidClear(asidset_t* set) {
+    int i;
+    for(i = 0; i < ASIDWORDS; i++) {
+        set->bits[i] = 0;
+    }
+}
+
+/************************************************************************************************************************/
+/********************************************** SHARED TEXT PAGES *******************************************************/
+/************************************************************************************************************************/
+
+/*
+* Function: Find Image
+* Finds an image with the same fingerprint and text size and counts the
+* uproc as one of its users, so the image stays while the caller compares
+* its text with the tape in tapeOf. Returns NOIMAGE if there is none.
+* Called with the swap pool semaphore held.
+*/
+int findImage(unsigned int fingerprint, int textPages, int* tapeOf) {
+    int i;
+    for(i = 0; i < MAXUPROC; i++) {
+        if((images[i].users > 0) && (images[i].fingerprint == fingerprint) &&
+            (images[i].textPages == textPages)) {
+            images[i].users++;
+            *tapeOf = images[i].tape;
+            return i;
+        }
+    }
+    return NOIMAGE;
+}
+
+/*
+* Function: Drop Image
+* Gives back the use findImage counted, when the texts turned out to
+* differ. The uproc never mapped a page of the image. Called with the
+* swap pool semaphore held.
+*/
+void dropImage(int image) {
+    images[image].users--;
+}
+
+/*
+* Function: Register Image
+* Takes a free slot for a new image, read from the tape, and counts the
+* uproc as its first user. Returns the image. Called with the swap pool
+* semaphore held.
+*/
+int registerImage(unsigned int fingerprint, int textPages, int tape) {
+    int i;
+    int j;
+    int freeSlot = NOIMAGE;
+    for(i = 0; (i < MAXUPROC) && (freeSlot == NOIMAGE); i++) {
+        if(images[i].users == 0) {
+            freeSlot = i;
+        }
+    }
+    /* there is a slot for every uproc */
+    images[freeSlot].fingerprint = fingerprint;
+    images[freeSlot].textPages = textPages;
+    images[freeSlot].tape = tape;
+    images[freeSlot].users = 1;
+    for(j = 0; j < KUSEGPTESIZE; j++) {
+        images[freeSlot].frames[j] = -1;
+    }
+    return freeSlot;
+}
+
+/* the image whose frame backs the page, NOIMAGE if it is not shared text */
+static int sharedImageOf(int ASID, int segmentNumber, int pageNumber) {
+    int image = uProcesses[ASID - 1].Tp_image;
+    if((segmentNumber == 3) || (image == NOIMAGE) || (pageNumber >= images[image].textPages)) {
+        return NOIMAGE;
+    }
+    return image;
+}
+
+/*
+* Function: Unshare Frame
+* Takes a shared page away from every uproc mapping it. For a copy on
+* write page that is every sharer; the pager writes the page back to each
+* of their swap groups. Text pages are never written, so they need no
+* writeback; the next touch reads the page from the tape again. Called
+* with the swap pool semaphore held.
+*/
+void unshareFrame(int frameNumber) {
+    int i;
+    int image = pool[frameNumber].image;
+    int pageNumber = pool[frameNumber].pageNumber;
+    memaddr frameAddress = swapPoolStart + (frameNumber * PAGESIZE);
+    if(asidCount(pool[frameNumber].sharers) != 0) {
+        for(i = 1; i <= MAXUPROC; i++) {
+            if(ASIDIN(pool[frameNumber].sharers, i)) {
+                uProcesses[i - 1].Tp_pte.pteTable[pageNumber].entryLO = ALLOFF | DIRTY;
+            }
+        }
+        /* only the owner was charged for the frame */
+        uProcesses[pool[frameNumber].ASID - 1].Tp_resident--;
+        asidClear(&(pool[frameNumber].sharers));
+        return;
+    }
+    for(i = 0; i < MAXUPROC; i++) {
+        pteEntry_PTR entry = &(uProcesses[i].Tp_pte.pteTable[pageNumber]);
+        if((uProcesses[i].Tp_image == image) && ((entry->entryLO & VALID) != 0) &&
+            ((entry->entryLO & LOCAL) == (frameAddress & LOCAL))) {
+            entry->entryLO = ALLOFF | DIRTY;
+        }
+    }
+    images[image].frames[pageNumber] = -1;
+    pool[frameNumber].image = NOIMAGE;
+    pool[frameNumber].refCount = 0;
+}
+
+/*
+* Function: Release Image
+* Drops a terminating uproc's references to the shared text pages of its
+* image. A frame nobody maps anymore goes back to the pool. Called with
+* the swap pool semaphore held.
+*/
+void releaseImage(int ASID) {
+    int pageNumber;
+    int frameNumber;
+    int image = uProcesses[ASID - 1].Tp_image;
+    if(image == NOIMAGE) {
+        return;
+    }
+    for(pageNumber = 0; pageNumber < images[image].textPages; pageNumber++) {
+        pteEntry_PTR entry = &(uProcesses[ASID - 1].Tp_pte.pteTable[pageNumber]);
+        frameNumber = images[image].frames[pageNumber];
+        if((frameNumber == -1) || pool[frameNumber].busy || ((entry->entryLO & VALID) == 0)) {
+            continue;
+        }
+        entry->entryLO = ALLOFF | DIRTY;
+        pool[frameNumber].refCount--;
+        if(pool[frameNumber].refCount == 0) {
+            invalidateEntry(frameNumber);
+        }
+    }
+    images[image].users--;
+    uProcesses[ASID - 1].Tp_image = NOIMAGE;
+}
+
+/************************************************************************************************************************/
+/********************************************** COPY ON WRITE ***********************************************************/
+/************************************************************************************************************************/
+
+/*
+* Function: Drop Sharer
+* Takes a uproc out of the sharers of a copy on write frame. If it was the
+* owner, the charge for the frame moves to another sharer. Once a single
+* sharer is left, the frame becomes its private, writable frame again.
+* Called with the swap pool semaphore held.
+*/
+static void dropSharer(int frameNumber, int ASID) {
+    int i;
+    int pageNumber = pool[frameNumber].pageNumber;
+    int left;
+    ASIDDEL(pool[frameNumber].sharers, ASID);
+    left = asidCount(pool[frameNumber].sharers);
+    if(left == 0) {
+        return;
+    }
+    if(pool[frameNumber].ASID == ASID) {
+        for(i = 1; !ASIDIN(pool[frameNumber].sharers, i); i++) {
+            ;
+        }
+        uProcesses[ASID - 1].Tp_resident--;
+        uProcesses[i - 1].Tp_resident++;
+        pool[frameNumber].ASID = i;
+        pool[frameNumber].pageTableEntry = &(uProcesses[i - 1].Tp_pte.pteTable[pageNumber]);
+    }
+    /* a single sharer left owns the page outright */
+    if(left == 1) {
+        pool[frameNumber].pageTableEntry->entryLO |= DIRTY;
+        asidClear(&(pool[frameNumber].sharers));
+    }
+}
+
+/*
+* Function: Settle Frames
+* Waits until no frame is in the middle of writing back one of the uproc's
+* pages or of copying a page it shares. Used before the uproc's pages are
+* forked or released. Called with the swap pool semaphore held.
+*/
+void settleFrames(int ASID) {
+    int i;
+    for(i = 0; i < swapPoolSize; i++) {
+        if(pool[i].busy && ((pool[i].victimASID == ASID) || ASIDIN(pool[i].victimSharers, ASID) ||
+            ASIDIN(pool[i].sharers, ASID))) {
+            pool[i].waiters++;
+            ownMutex(FALSE, &(swapSemaphore));
+            mutex(TRUE, &(pool[i].frameSem));
+            ownMutex(TRUE, &(swapSemaphore));
+            /* look again from the start */
+            i = -1;
+        }
+    }
+}
+
+/*
+* Function: Fork Frames
+* Shares every resident private kUseg2 page of the parent with the child,
+* copy on write: both page tables map the frame without the DIRTY bit,
+* so the first write of either one takes a TLB-Mod exception and the pager
+* gives the writer a copy of its own. Returns a bitmap of the pages shared.
+* Called with the swap pool semaphore held.
+*/
+int forkFrames(int parent, int child) {
+    int i;
+    int pageNumber;
+    int shared = 0;
+    memaddr frameAddress;
+    for(i = 0; i < swapPoolSize; i++) {
+        if((pool[i].segmentNumber == 3) || (pool[i].image != NOIMAGE) ||
+            ((pool[i].ASID != parent) && (!ASIDIN(pool[i].sharers, parent)))) {
+            continue;
+        }
+        pageNumber = pool[i].pageNumber;
+        frameAddress = swapPoolStart + (i * PAGESIZE);
+        if(asidCount(pool[i].sharers) == 0) {
+            ASIDADD(pool[i].sharers, parent);
+            uProcesses[parent - 1].Tp_pte.pteTable[pageNumber].entryLO &= ~DIRTY;
+        }
+        ASIDADD(pool[i].sharers, child);
+        uProcesses[child - 1].Tp_pte.pteTable[pageNumber].entryLO = (frameAddress & LOCAL) | VALID;
+        shared |= PAGEBIT(pageNumber);
+    }
+    /* the child runs the parent's image */
+    if(uProcesses[parent - 1].Tp_image != NOIMAGE) {
+        images[uProcesses[parent - 1].Tp_image].users++;
+    }
+    /* the parent may have run on another processor with its pages writable */
+    tlbShootdown(parent, ALLPAGES);
+    return shared;
+}
+
+/*
+* Function: Release Copy On Write Shares
+* Drops a terminating uproc out of every copy on write frame it shares.
+* Called with the swap pool semaphore held.
+*/
+void releaseCowShares(int ASID) {
+    int i;
+    for(i = 0; i < swapPoolSize; i++) {
+        if(!ASIDIN(pool[i].sharers, ASID)) {
+            continue;
+        }
+        dropSharer(i, ASID);
+        /* a frame left to us alone is freed with the private ones */
+        if(pool[i].ASID != ASID) {
+            uProcesses[ASID - 1].Tp_pte.pteTable[pool[i].pageNumber].entryLO = ALLOFF | DIRTY;
+        }
+    }
+}
+
+/*
+* Function: Write Back
+* Writes a victim page out of its frame to the swap group of its owner,
+* or of every sharer when the page was copy on write. Called without the 
+* swap pool semaphore, which is taken only to mark the page backed.
+*/
+static void writeBack(int victimASID, asidset_t victimSharers, int segmentNumber, int pageNumber,
+    memaddr frameAddress) {
+    int i;
+    int diskInformation[DISKPARAMS];
+    device_PTR diskDevice = (device_PTR)DISKDEV;
+    if(asidCount(victimSharers) == 0) {
+        ASIDADD(victimSharers, victimASID);
+    }
+    for(i = 0; i <= MAXUPROC; i++) {
+        if(!ASIDIN(victimSharers, i)) {
+            continue;
+        }
+        swapLocate(i, segmentNumber, pageNumber, diskInformation);
+        diskInformation[PAGELOCATION] = frameAddress;
+        diskInformation[READWRITE] = WRITEBLK;
+        diskOperation(diskInformation, (&(diskSemaphores[diskInformation[DISKNUM]])), diskDevice);
+        /* from now on the page must be read back from the disk; the 
+        other pagers update the same bitmaps */
+        ownMutex(TRUE, &(swapSemaphore));
+        markBacked(i, segmentNumber, pageNumber);
+        ownMutex(FALSE, &(swapSemaphore));
+    }
+}
+
+/*
+* Function: Zero Frame
+* Clears a swap pool frame. Used to satisfy the first touch of a page
+* that has never been swapped out, since there is nothing on the
+* backing store to read for it.
+*/
+static void zeroFrame(memaddr frameAddress) {
+    int* word = (int*) frameAddress;
+    int i;
+    for(i = 0; i < (PAGESIZE / WORDLEN); i++) {
+        word[i] = 0;
     }
-    lastFrame++;
-    return lastFrame;
 }
 
-/* the pager for the TLB exception */
+/* copies a page from one frame to another */
+static void copyFrame(memaddr from, memaddr to) {
+    int* source = (int*) from;
+    int* destination = (int*) to;
+    int i;
+    for(i = 0; i < (PAGESIZE / WORDLEN); i++) {
+        destination[i] = source[i];
+    }
+}
+
+/*
+* Function: Tape Seek
+* The tape only moves a block at a time, so the head is walked forward or
+* back to the block of the page; faults usually touch the image in order,
+* so this is seldom more than a block or two. A forked uproc reads its
+* image from its parent's tape, and a new uproc may read the tape of an
+* image it matches, so the caller holds the tape's semaphore. The buffer
+* is only named to the skips; nothing is read into it.
+*/
+void tapeSeek(int tape, int block, memaddr buffer) {
+    while(tapePos[tape] < block) {
+        tapeOperation(tape, SKIPBLK, buffer);
+        tapePos[tape]++;
+    }
+    while(tapePos[tape] > block) {
+        tapeOperation(tape, BACKBLK, buffer);
+        tapePos[tape]--;
+    }
+}
+
+/* is the page's first touch served by the tape? */
+static int onTape(int ASID, int segmentNumber, int pageNumber) {
+    return ((segmentNumber != 3) && (pageNumber < uProcesses[ASID - 1].Tp_tapeBlocks) &&
+        (!isBacked(ASID, segmentNumber, pageNumber)));
+}
+
+/*
+* Function: Find In Transit
+* Looks for a busy frame that is either bringing the page in or writing
+* it back out. Returns the frame number, or -1 if the page is not moving.
+* Called with the swap pool semaphore held.
+*/
+static int findInTransit(int ASID, int segmentNumber, int pageNumber) {
+    int i;
+    int image = sharedImageOf(ASID, segmentNumber, pageNumber);
+    for(i = 0; i < swapPoolSize; i++) {
+        if(!pool[i].busy) {
+            continue;
+        }
+        /* another uproc of the image is bringing the text page in */
+        if((image != NOIMAGE) && (pool[i].image == image) && (pool[i].pageNumber == pageNumber)) {
+            return i;
+        }
+        /* kUseg3 pages belong to everyone */
+        if((pool[i].segmentNumber == segmentNumber) && (pool[i].pageNumber == pageNumber) &&
+            ((segmentNumber == 3) || (pool[i].ASID == ASID))) {
+            return i;
+        }
+        if((pool[i].victimASID != -1) && (pool[i].victimSegment == segmentNumber) &&
+            (pool[i].victimPage == pageNumber) && ((segmentNumber == 3) || (pool[i].victimASID == ASID) ||
+            ASIDIN(pool[i].victimSharers, ASID))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* the page table entry of a page */
+static pteEntry_PTR pageTableEntryOf(int ASID, int segmentNumber, int pageNumber) {
+    if(segmentNumber == 3) {
+        return &(kUseg3.pteTable[pageNumber]);
+    }
+    return &(uProcesses[ASID - 1].Tp_pte.pteTable[pageNumber]);
+}
+
+/*
+* Function: Pager
+* The TLB exception handler of the uprocs. The swap pool semaphore is only
+* held for two short critical sections: one to pick a victim frame and
+* reserve it by marking it busy, and one to install the new mapping. The
+* disk I/O in between runs with only the frame reserved, so faults of other
+* uprocs on other frames proceed at the same time and queue up on the
+* disk semaphores instead of on the swap pool. A uproc that faults on a
+* page whose frame is busy waits on that frame and then retries. Text
+* pages of uprocs running the same image share one read-only frame; a
+* fault on a text page another uproc already has resident only maps it.
+* A write to a copy on write page comes here as a TLB-Mod exception: the
+* last sharer just gets the DIRTY bit back, any other sharer gets a copy
+* of the page in a frame of its own.
+*/
 void pager() {
-    /* acquire the mutex on the swapool metaphor */
-    mutex(TRUE, &(swapSemaphore));
+    int i;
+    int frameNumber;
+    int preservedStatus;
+    int victimASID;
+    int victimSegment;
+    int victimPage;
+    asidset_t victimSharers;
+    int copySource = -1;
+    memaddr frameAddress;
+    /* information for the disk */
+    int diskInformation[DISKPARAMS];
+    device_PTR diskDevice = (device_PTR)DISKDEV;
     /* get the current asid */
     int ASID = extractASID();
     /* why are we here */
     /*examine oldmem cause register */
-    state_PTR state = &(uProcesses[extractASID() - 1].Told_trap[TLBTRAP]);
-    /* the device register */
-    devregarea_PTR bus = (devregarea_PTR)RAMBASEADDR;
-    memaddr RAMTOP = bus->rambase + bus->ramsize;
-    /* start of the first frame */
-    memaddr swapPoolStart = ((bus->rambase + bus->ramsize) - (3 * PAGESIZE));
+    state_PTR state = &(uProcesses[ASID - 1].Told_trap[TLBTRAP]);
     /* get the cause of the fault */
     int cause = (state->s_cause & 0x3C) >> EXCMASK;
-    /* who am I? */
-    /* get current processid in ASID register */
-    /* this is needed as the index into the phase3 global structure */
-    int missingASID = ((getENTRYHI() & 0x3FFFF000) >> ASIDMASK);
-    device_PTR diskDevice = (device_PTR)DISKDEV;
     /* get the cause */
     /* if TLB Invalid then SYS18 */
     /* 2 and 3 only valid TLB causes (pg 16 in yellow book) */
-    if ((cause != TLBL) && (cause != TLBS)) {
+    if ((cause != TLBL) && (cause != TLBS) && (cause != TLBMOD)) {
         terminateUProcess();
     }
     /* which page is missing */
-    /*oldMem ASID register has segment no and page no */
-    /*not sure about 30, will revisit later */
+    /* the saved entryHI holds the segment and the page number */
     int segmentNumber = (state->s_asid >> SEGMENTMASK);
-    /* i think that 0x3FFFF000 covers the asid but im not sure */
-    int pageNumber = ((state->s_asid & 0x3FFFF000) >> VPNMASK);
+    int pageNumber = (((state->s_asid & LOCAL) >> VPNMASK) - BASEADDR);
+    /* the stack page sits at the very end of kUseg2 */
+    if(segmentNumber == 3) {
+        pageNumber = (((state->s_asid & LOCAL) >> VPNMASK) - KUSEG3ADDRBASE);
+    } else if(pageNumber >= KUSEGPTESIZE) {
+        pageNumber = KUSEGPTESIZE - 1;
+    }
+    pteEntry_PTR pageTableEntry = pageTableEntryOf(ASID, segmentNumber, pageNumber);
+    /* the load controller picked us as the worst offender; sit out a 
+    few clock ticks so the others can keep their working sets */
+    if(uProcesses[ASID - 1].Tp_suspended) {
+        for(i = 0; i < SUSPENDTICKS; i++) {
+            SYSCALL(WAITCLOCK, EMPTY, EMPTY, EMPTY);
+        }
+    }
+    /* acquire the mutex on the swapool metaphor */
+    ownMutex(TRUE, &(swapSemaphore));
+    if(uProcesses[ASID - 1].Tp_suspended) {
+        releaseUProcLoad(ASID);
+    }
+    /* if the page is on its way in or out, wait for the frame to settle */
+    frameNumber = findInTransit(ASID, segmentNumber, pageNumber);
+    while(frameNumber != -1) {
+        pool[frameNumber].waiters++;
+        ownMutex(FALSE, &(swapSemaphore));
+        mutex(TRUE, &(pool[frameNumber].frameSem));
+        ownMutex(TRUE, &(swapSemaphore));
+        frameNumber = findInTransit(ASID, segmentNumber, pageNumber);
+    }
+    /* a write to a read only page */
+    while(cause == TLBMOD) {
+        frameNumber = ((pageTableEntry->entryLO & LOCAL) - swapPoolStart) / PAGESIZE;
+        /* the page was taken away while we waited; the retry faults it in */
+        if((pageTableEntry->entryLO & VALID) == 0) {
+            TLBCLR();
+            ownMutex(FALSE, &(swapSemaphore));
+            contextSwitch(state);
+        }
+        /* the other sharers copied the page away and left it writable to us;
+        the fault came from a stale read only entry, so the retry goes through */
+        if((pageTableEntry->entryLO & DIRTY) != 0) {
+            TLBCLR();
+            ownMutex(FALSE, &(swapSemaphore));
+            contextSwitch(state);
+        }
+        /* a write to the text */
+        if((segmentNumber == 3) || (!ASIDIN(pool[frameNumber].sharers, ASID))) {
+            ownMutex(FALSE, &(swapSemaphore));
+            terminateUProcess();
+        }
+        /* another sharer is copying the page; wait for it */
+        if(pool[frameNumber].busy) {
+            pool[frameNumber].waiters++;
+            ownMutex(FALSE, &(swapSemaphore));
+            mutex(TRUE, &(pool[frameNumber].frameSem));
+            ownMutex(TRUE, &(swapSemaphore));
+            continue;
+        }
+        /* the last sharer keeps the frame */
+        if(asidCount(pool[frameNumber].sharers) == 1) {
+            dropSharer(frameNumber, ASID);
+            pageTableEntry->entryLO |= DIRTY;
+            TLBCLR();
+            ownMutex(FALSE, &(swapSemaphore));
+            contextSwitch(state);
+        }
+        /* pin the page while we copy it */
+        copySource = frameNumber;
+        pool[copySource].busy = TRUE;
+        break;
+    }
+    /* someone else brought a shared page in while we waited */
+    if((copySource == -1) && ((pageTableEntry->entryLO & VALID) != 0)) {
+        TLBCLR();
+        ownMutex(FALSE, &(swapSemaphore));
+        contextSwitch(state);
+    }
+    /* account the fault with the load controller */
+    countFault(ASID);
+    /* a text page another uproc of the image already brought in */
+    int image = sharedImageOf(ASID, segmentNumber, pageNumber);
+    if((image != NOIMAGE) && (images[image].frames[pageNumber] != -1)) {
+        frameNumber = images[image].frames[pageNumber];
+        frameAddress = swapPoolStart + (frameNumber * PAGESIZE);
+        pool[frameNumber].refCount++;
+        /* read only, so a write to the text ends the uproc */
+        pageTableEntry->entryLO = (frameAddress & LOCAL) | VALID;
+        TLBCLR();
+        ownMutex(FALSE, &(swapSemaphore));
+        contextSwitch(state);
+    }
     /* pick a frame to use */
-    int frameNumber = next();
-    swapPoolStart = swapPoolStart + (frameNumber * PAGESIZE);
-
-    /* information for the disk */
-    int diskInformation[DISKPARAMS];
-    diskInformation[HEAD] = EMPTY;
-    diskInformation[DISKNUM] = EMPTY;
-    diskInformation[PAGELOCATION] = pageNumber;
-    /* what type of operation is it? */
-    diskInformation[READWRITE] = WRITEBLK;
-    /* save out status for interrupts */
-    int preservedStatus;
-    /* if the frame is currently occupied */
+    frameNumber = pickFrame(ASID, segmentNumber);
+    /* every frame is being filled; wait for one to settle and retry the access */
+    if(frameNumber == -1) {
+        if(copySource != -1) {
+            unpinFrame(copySource);
+        }
+        frameWaiters++;
+        ownMutex(FALSE, &(swapSemaphore));
+        mutex(TRUE, &(frameFreeSem));
+        contextSwitch(state);
+    }
+    frameAddress = swapPoolStart + (frameNumber * PAGESIZE);
+    /* if the frame is currently occupied, take it away from its owner */
+    victimASID = -1;
+    asidClear(&victimSharers);
     if(pool[frameNumber].ASID != -1) {
         preservedStatus = getSTATUS();
         setSTATUS(ALLOFF);
-        /* turn the valid bit off in the page table of the current frames occupent */
-        int squatterASID = pool[frameNumber].ASID - 1;
-        int squatterPageNum = pool[frameNumber].pageNumber;
-        if(pageNumber >= KUSEGPTESIZE) {
-            pageNumber = KUSEGPTESIZE - 1;
+        /* a shared text page is clean and needs no writeback */
+        if(pool[frameNumber].image == NOIMAGE) {
+            victimASID = pool[frameNumber].ASID;
+            victimSharers = pool[frameNumber].sharers;
+            victimSegment = pool[frameNumber].segmentNumber;
+            victimPage = pool[frameNumber].pageNumber;
         }
-        
-        /* write current frames contents on the backing store */
+        /* turn the valid bit off in the page table of the current frames occupent */
         invalidateEntry(frameNumber);
-        /* get the information ready for the disk */
-        diskInformation[SECTOR] = squatterASID;
-        diskInformation[CYLINDER] = squatterPageNum;
         /* reenable the enterrupts */
         setSTATUS(preservedStatus);
-        /* perform a disk operation */
-        diskOperation(diskInformation, (&(disk0Semaphore)), diskDevice);
-        
     }
-    /* reset the disk information */
-    diskInformation[SECTOR] = ASID - 1;
-    diskInformation[CYLINDER] = pageNumber;
-    diskInformation[READWRITE] = READBLK;
-    /* read missing page into selected frame */
-    diskOperation(pageNumber, (&(disk0Semaphore)), diskDevice);
-
-
-    /*update the swapool data structure */
-    pool[frameNumber].ASID = missingASID;
+    /* reserve the frame for our page */
+    pool[frameNumber].busy = TRUE;
+    pool[frameNumber].victimASID = victimASID;
+    pool[frameNumber].victimSharers = victimSharers;
+    pool[frameNumber].victimSegment = victimSegment;
+    pool[frameNumber].victimPage = victimPage;
+    freeFrames--;
+    if(image != NOIMAGE) {
+        /* shared frames are charged to nobody's resident set */
+        pool[frameNumber].ASID = SHAREDFRAME;
+        pool[frameNumber].image = image;
+        pool[frameNumber].refCount = 1;
+        images[image].frames[pageNumber] = frameNumber;
+    } else {
+        if(segmentNumber != 3) {
+            uProcesses[ASID - 1].Tp_resident++;
+        }
+        pool[frameNumber].ASID = ASID;
+    }
     pool[frameNumber].segmentNumber = segmentNumber;
     pool[frameNumber].pageNumber = pageNumber;
+    pool[frameNumber].pageTableEntry = pageTableEntry;
+    ownMutex(FALSE, &(swapSemaphore));
+
+    /* an image page that evicts a victim is read into the tape buffer while 
+    the victim is written out of the frame, so the tape and the disk are 
+    busy at the same time */
+    int tape = uProcesses[ASID - 1].Tp_tape;
+    int overlapped = FALSE;
+    if((victimASID != -1) && (copySource == -1) && onTape(ASID, segmentNumber, pageNumber)) {
+        ownMutex(TRUE, &(tapeSemaphores[tape]));
+        tapeSeek(tape, pageNumber, TAPEBUFFER(ASID));
+        tapeStart(tape, READBLK, TAPEBUFFER(ASID));
+        overlapped = TRUE;
+    }
+    /* write the victim's contents on the backing store */
+    if(victimASID != -1) {
+        writeBack(victimASID, victimSharers, victimSegment, victimPage, frameAddress);
+    }
+    diskInformation[PAGELOCATION] = frameAddress;
+    if(copySource != -1) {
+        /* our own copy of the shared page */
+        copyFrame(swapPoolStart + (copySource * PAGESIZE), frameAddress);
+    } else if(overlapped) {
+        /* the tape has been reading all along */
+        tapeWait(tape);
+        tapePos[tape]++;
+        ownMutex(FALSE, &(tapeSemaphores[tape]));
+        copyFrame(TAPEBUFFER(ASID), frameAddress);
+    } else if(isBacked(ASID, segmentNumber, pageNumber)) {
+        /* read missing page into selected frame */
+        swapLocate(ASID, segmentNumber, pageNumber, diskInformation);
+        diskInformation[READWRITE] = READBLK;
+        diskOperation(diskInformation, (&(diskSemaphores[diskInformation[DISKNUM]])), diskDevice);
+    } else if(onTape(ASID, segmentNumber, pageNumber)) {
+        /* the first touch of an image page comes from the tape */
+        ownMutex(TRUE, &(tapeSemaphores[tape]));
+        tapeSeek(tape, pageNumber, TAPEBUFFER(ASID));
+        tapeOperation(tape, READBLK, frameAddress);
+        tapePos[tape]++;
+        ownMutex(FALSE, &(tapeSemaphores[tape]));
+    } else {
+        /* a page that was never swapped out and is not part of the image 
+        holds nothing, so its first touch is served by a zeroed frame */
+        zeroFrame(frameAddress);
+    }
+
+    /* install the mapping and let the waiters retry */
+    ownMutex(TRUE, &(swapSemaphore));
     /* update missing pages page table entry: frame and valid bit */
     if (segmentNumber == 3) {
-        pool[frameNumber].pageTableEntry = &(kUseg3.pteTable[pageNumber]);
-        pool[frameNumber].pageTableEntry->entryLO = swapPoolStart | VALID | DIRTY | GLOBAL;
+        pageTableEntry->entryLO = frameAddress | VALID | DIRTY | GLOBAL;
+    } else if(image != NOIMAGE) {
+        pageTableEntry->entryLO = (frameAddress & LOCAL) | VALID;
     } else {
-        pool[frameNumber].pageTableEntry = &(uProcesses[missingASID].Tp_pte.pteTable[pageNumber]);
-        pool[frameNumber].pageTableEntry->entryLO = (swapPoolStart & LOCAL) | VALID | DIRTY | GLOBAL;
+        pageTableEntry->entryLO = (frameAddress & LOCAL) | VALID | DIRTY;
+    }
+    pool[frameNumber].victimASID = -1;
+    asidClear(&(pool[frameNumber].victimSharers));
+    unpinFrame(frameNumber);
+    /* we no longer share the page we copied */
+    if(copySource != -1) {
+        dropSharer(copySource, ASID);
+        unpinFrame(copySource);
     }
     /* deal with the cache consitency */
     TLBCLR();
-    
+
     /*release mutex and return control to process */
-    mutex(FALSE, (&(swapSemaphore)));
-    
+    ownMutex(FALSE, (&(swapSemaphore)));
+
     contextSwitch(state);
 }
-
-
-
-
-
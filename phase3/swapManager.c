@@ -0,0 +1,265 @@
+/*************************************************** swapManager.c *****************************************************
+	Manages the backing store of the support level. The swap space is striped across every installed disk: slot i
+    lives on the (i mod n)th disk, so consecutive pages of a uproc alternate between the disks and page-ins and
+    writebacks on different disks can proceed at the same time. disk0 gives all of its cylinders to swapping, the
+    other disks give the upper half of theirs and keep the lower half for the disk syscalls. The swap space is divided
+    into slots of one page each, and a bitmap records which slots are taken. Every uproc (and the shared kUseg3
+    segment) is given a group of KUSEGPTESIZE contiguous slots when it is created, laid out so that each disk's share
+    of the group stays within as few cylinders as the disk geometry allows. Neighbouring pages of a uproc are
+    therefore neighbouring sectors on their disks, and swapping them back in needs little or no seeking. The manager also keeps track of which pages actually hold
+    data on the backing store, so that it can report how much of the swap space is in use.
+
+***************************************************** swapManager.c ****************************************************/
+
+/* h files to include */
+#include "../h/const.h"
+#include "../h/types.h"
+/* e files to include */
+#include "../e/initProc.e"
+#include "../e/swapManager.e"
+/* include the µmps2 library */
+#include "/usr/local/include/umps2/umps/libumps.e"
+
+/* GLOBAL VARIABLES */
+/* one bit per slot, set when the slot belongs to a group */
+HIDDEN unsigned int swapMap[SWAPMAPWORDS];
+/* the disks the swap space is striped across */
+HIDDEN int swapDiskCount;
+HIDDEN int swapDiskNum[DEVPERINT];
+HIDDEN int swapBaseCylinder[DEVPERINT];
+/* the geometry common to every swap disk */
+HIDDEN int sectorsPerTrack;
+HIDDEN int slotsPerCylinder;
+HIDDEN int totalSlots;
+/* the slots that hold a page and the slots reserved for groups */
+HIDDEN int usedSlots;
+HIDDEN int reservedSlots;
+/* the first slot of the kUseg3 group */
+HIDDEN int kUseg3Slot;
+/* END OF GLOBAL VARIABLES */
+
+/************************************************************************************************************************/
+/******************************************** HELPER FUNCTIONS  *********************************************************/
+/************************************************************************************************************************/
+
+/* is the slot taken? */
+static int slotTaken(int slot) {
+    return ((swapMap[slot / 32] & (1 << (slot % 32))) != 0);
+}
+
+/* marks a slot as taken or free */
+static void setSlot(int slot, int taken) {
+    if(taken) {
+        swapMap[slot / 32] |= (1 << (slot % 32));
+    } else {
+        swapMap[slot / 32] &= ~(1 << (slot % 32));
+    }
+}
+
+/*
+* Function: Find Group
+* First fit search of the bitmap for KUSEGPTESIZE free slots in a row. A
+* group starts on a stripe boundary, so each disk holds an equal, contiguous
+* share of it. When a cylinder can hold a disk's share, the share never
+* crosses a cylinder boundary; otherwise it starts on a cylinder boundary
+* so it spans as few cylinders as possible. Returns NOSLOT if the swap
+* space is full.
+*/
+static int findGroup() {
+    int start = 0;
+    int slot;
+    int offset;
+    /* the slots of a group that land on each disk */
+    int share = (KUSEGPTESIZE + swapDiskCount - 1) / swapDiskCount;
+    while((start + KUSEGPTESIZE) <= totalSlots) {
+        offset = (start / swapDiskCount) % slotsPerCylinder;
+        /* move to the next cylinder when the share would not fit */
+        if(((slotsPerCylinder >= share) && ((offset + share) > slotsPerCylinder)) ||
+            ((slotsPerCylinder < share) && (offset != 0))) {
+            start = start + ((slotsPerCylinder - offset) * swapDiskCount);
+            continue;
+        }
+        /* look for a taken slot in the candidate group */
+        for(slot = start; slot < (start + KUSEGPTESIZE); slot++) {
+            if(slotTaken(slot)) {
+                break;
+            }
+        }
+        if(slot == (start + KUSEGPTESIZE)) {
+            /* all free */
+            return start;
+        }
+        /* the next stripe boundary past the taken slot */
+        start = ((slot / swapDiskCount) + 1) * swapDiskCount;
+    }
+    return NOSLOT;
+}
+
+/* the first slot of the group backing a segment */
+static int groupOf(int ASID, int segmentNumber) {
+    if(segmentNumber == 3) {
+        return kUseg3Slot;
+    }
+    return uProcesses[ASID - 1].diskAddr;
+}
+
+/* the bitmap of pages that hold data on the backing store */
+static unsigned int* backedMap(int ASID, int segmentNumber) {
+    if(segmentNumber == 3) {
+        return &(kUseg3Backed);
+    }
+    return &(uProcesses[ASID - 1].Tp_backed);
+}
+
+/************************************************************************************************************************/
+/********************************************** SWAP SPACE MANAGER ******************************************************/
+/************************************************************************************************************************/
+
+/*
+* Function: Initialize Swap Space
+* Finds the installed disks from the installed devices bitmap and reads
+* their geometry from the DATA1 registers. The swap space uses the fewest
+* cylinders, heads and sectors of them all, each taken on its own, so every
+* disk holds the same number of slots and every head and sector that
+* swapLocate computes exists on every disk.
+* Then it clears the slot bitmap and reserves the group for the shared
+* kUseg3 segment.
+*/
+void initSwapSpace() {
+    int i;
+    int cylinders;
+    int heads = FULLBYTE;
+    int diskSlots;
+    int swapCylinders = MAXINT;
+    devregarea_PTR devReg = (devregarea_PTR) RAMBASEADDR;
+    unsigned int installed = devReg->inst_dev[DISKINT - NOSEM];
+    unsigned int geometry;
+    swapDiskCount = 0;
+    sectorsPerTrack = FULLBYTE;
+    for(i = 0; i < DEVPERINT; i++) {
+        if((installed & (FIRST << i)) == 0) {
+            continue;
+        }
+        geometry = devReg->devreg[((DISKINT - NOSEM) * DEVPERINT) + i].d_data1;
+        cylinders = (geometry >> GEOCYLSHIFT);
+        heads = MIN(heads, (int) ((geometry >> GEOHEADSHIFT) & FULLBYTE));
+        sectorsPerTrack = MIN(sectorsPerTrack, (int) (geometry & FULLBYTE));
+        swapDiskNum[swapDiskCount] = i;
+        /* disk0 is all swap; the others keep their lower half */
+        if(i == 0) {
+            swapBaseCylinder[swapDiskCount] = 0;
+        } else {
+            swapBaseCylinder[swapDiskCount] = cylinders - (cylinders / 2);
+        }
+        swapCylinders = MIN(swapCylinders, cylinders - swapBaseCylinder[swapDiskCount]);
+        swapDiskCount++;
+    }
+    /* no disk, no backing store */
+    if(swapDiskCount == 0) {
+        PANIC();
+    }
+    slotsPerCylinder = heads * sectorsPerTrack;
+    diskSlots = swapCylinders * slotsPerCylinder;
+    totalSlots = MIN(diskSlots * swapDiskCount, MAXSWAPSLOTS);
+    /* keep whole stripes only */
+    totalSlots = totalSlots - (totalSlots % swapDiskCount);
+    for(i = 0; i < SWAPMAPWORDS; i++) {
+        swapMap[i] = 0;
+    }
+    usedSlots = 0;
+    reservedSlots = 0;
+    /* kUseg3 is shared by everyone, so it gets a group of its own */
+    kUseg3Slot = findGroup();
+    if(kUseg3Slot == NOSLOT) {
+        PANIC();
+    }
+    for(i = 0; i < KUSEGPTESIZE; i++) {
+        setSlot(kUseg3Slot + i, TRUE);
+    }
+    reservedSlots += KUSEGPTESIZE;
+}
+
+/*
+* Function: Reserve Swap Group
+* Gives a uproc the group of slots its pages will live in. Returns
+* FAILURE if the backing store has no room left for another uproc.
+*/
+int reserveSwapGroup(int ASID) {
+    int i;
+    int start = findGroup();
+    if(start == NOSLOT) {
+        return FAILURE;
+    }
+    for(i = 0; i < KUSEGPTESIZE; i++) {
+        setSlot(start + i, TRUE);
+    }
+    reservedSlots += KUSEGPTESIZE;
+    uProcesses[ASID - 1].diskAddr = start;
+    uProcesses[ASID - 1].Tp_backed = 0;
+    return SUCCESS;
+}
+
+/*
+* Function: Release Swap Group
+* Returns the slots of a terminating uproc to the bitmap.
+*/
+void releaseSwapGroup(int ASID) {
+    int i;
+    Tproc_PTR uproc = &(uProcesses[ASID - 1]);
+    if(uproc->diskAddr == NOSLOT) {
+        return;
+    }
+    for(i = 0; i < KUSEGPTESIZE; i++) {
+        if((uproc->Tp_backed & PAGEBIT(i)) != 0) {
+            usedSlots--;
+        }
+        setSlot(uproc->diskAddr + i, FALSE);
+    }
+    reservedSlots -= KUSEGPTESIZE;
+    uproc->Tp_backed = 0;
+    uproc->diskAddr = NOSLOT;
+}
+
+/*
+* Function: Swap Locate
+* Fills in the disk, sector, head and cylinder of the slot backing a page.
+*/
+void swapLocate(int ASID, int segmentNumber, int pageNumber, int diskInformation[]) {
+    int slot = groupOf(ASID, segmentNumber) + pageNumber;
+    /* which disk of the stripe, and where on that disk */
+    int stripe = slot % swapDiskCount;
+    int diskSlot = slot / swapDiskCount;
+    int offset = diskSlot % slotsPerCylinder;
+    diskInformation[CYLINDER] = swapBaseCylinder[stripe] + (diskSlot / slotsPerCylinder);
+    diskInformation[HEAD] = offset / sectorsPerTrack;
+    diskInformation[SECTOR] = offset % sectorsPerTrack;
+    diskInformation[DISKNUM] = swapDiskNum[stripe];
+}
+
+/* has the page been written to the backing store? */
+int isBacked(int ASID, int segmentNumber, int pageNumber) {
+    return ((*(backedMap(ASID, segmentNumber)) & PAGEBIT(pageNumber)) != 0);
+}
+
+/* records that the page now holds data on the backing store; the 
+caller holds the swap pool semaphore, as the pagers share the bitmaps */
+void markBacked(int ASID, int segmentNumber, int pageNumber) {
+    unsigned int* backed = backedMap(ASID, segmentNumber);
+    if(((*backed) & PAGEBIT(pageNumber)) == 0) {
+        usedSlots++;
+    }
+    (*backed) |= PAGEBIT(pageNumber);
+}
+
+/*
+* Function: Swap Utilization
+* Reports the use of the backing store: the slots holding a page, the
+* slots reserved for groups and the slots there are in total. Returns the
+* percentage of the swap space holding pages.
+*/
+int swapUtilization(int* used, int* reserved, int* total) {
+    (*used) = usedSlots;
+    (*reserved) = reservedSlots;
+    (*total) = totalSlots;
+    return (usedSlots * 100) / totalSlots;
+}
@@ -6,9 +6,17 @@
 #include "../e/exceptions.e"
 #include "../e/initProc.e"
 #include "../e/pager.e"
+#include "../e/swapManager.e"
+#include "../e/heap.e"
+#include "../e/sysSupport.e"
+#include "../e/initial.e"
 /* include the µmps2 library */
 #include "/usr/local/include/umps2/umps/libumps.e"
 
+/* helpers used before they are defined */
+static void forkUProcess(state_PTR state);
+static void getSwap(state_PTR state);
+
 void uSyscallHandler() {
     state_PTR state = (&((uProcesses[extractASID()-1]).Told_trap[SYSTRAP]));
     delegateUSyscall(state);
@@ -62,6 +70,12 @@ static void delegateUSyscall(state_PTR state) {
         case TERMINATE:
             terminateUProcess();
             break;
+        case FORK:
+            forkUProcess(state);
+            break;
+        case GET_SWAP:
+            getSwap(state);
+            break;
     }
 }
 
@@ -70,15 +84,21 @@ static void readFromTerminal(state_PTR state) {
     device_PTR printerDevice = (device_PTR) PRINTERDEV + (asidIndex * DEVREGSIZE); */
     
     char* address = state->s_a1;
-    int ASID = ((getENTRYHI() & 0x19DEBB4FC0) >> ASIDMASK);
+    int ASID = extractASID();
+    int terminalNumber = uProcesses[ASID - 1].Tp_terminal;
+    /* no terminal, nothing to read */
+    if(terminalNumber == NODEVICE) {
+        state->s_v0 = -1;
+        contextSwitch(state);
+    }
     /* call dibs */
-    SYSCALL(PASSEREN, (int)&mutexSemaphores[32 + (ASID -1)], 0, 0);
+    ownMutex(TRUE, &(mutexSemaphores[TERMRECVSEM(terminalNumber)]));
     int done = FALSE;
     unsigned int status;
     /* find that pesky terminal */
     state_PTR oldState = (state_PTR) &uProcesses[ASID - 1].Told_trap[2];
     devregarea_PTR devReg = (devregarea_PTR) RAMBASEADDR;
-    int deviceNumber = 32 + (ASID - 1);
+    int deviceNumber = ((TERMINT - NOSEM) * DEVPERINT) + terminalNumber;
     device_PTR terminal = &(devReg->devreg[deviceNumber]);
     int total = 0;
     
@@ -89,7 +109,7 @@ static void readFromTerminal(state_PTR state) {
         /*tell the machine to read from the terminal */
         terminal->t_recv_command = 2;
         /*then tell it to do it */
-        status = SYSCALL(WAITIO, TERMINT, (ASID -1), 1);
+        status = SYSCALL(WAITIO, TERMINT, terminalNumber, 1);
         enableInterrupts ();
         
         /* check if we are done */
@@ -112,19 +132,25 @@ static void readFromTerminal(state_PTR state) {
     state->s_v0 = total;
     
     /* RELEASE THE KRAKEN...by which i mean release the mutex */
-    SYSCALL (VERHOGEN, (int)&mutexSemaphores[32 + (ASID - 1)], 0, 0);
+    ownMutex(FALSE, &(mutexSemaphores[TERMRECVSEM(terminalNumber)]));
 }
 
 static void writeToTerminal(state_PTR state) {
     char *address = state->s_a1;
     char *length = state->s_a2;
     int ASID = ((getENTRYHI() & 0x00000FC0) >> ASIDMASK);
-    int deviceNumber = 32 + (ASID - 1);
+    int terminalNumber = uProcesses[ASID - 1].Tp_terminal;
+    /* no terminal, nothing to write to */
+    if(terminalNumber == NODEVICE) {
+        state->s_v0 = -1;
+        contextSwitch(state);
+    }
+    int deviceNumber = ((TERMINT - NOSEM) * DEVPERINT) + terminalNumber;
     devregarea_PTR devReg = (devregarea_PTR) RAMBASEADDR;
     device_PTR terminal = &(devReg->devreg[deviceNumber]);
     
     /* call dibs */
-    SYSCALL (PASSEREN, (int)&mutexSemaphores[40 + (ASID - 1)], 0, 0);
+    ownMutex(TRUE, &(mutexSemaphores[TERMTRANSMSEM(terminalNumber)]));
     
     unsigned int status;
     /* loop to write the string */
@@ -134,7 +160,7 @@ static void writeToTerminal(state_PTR state) {
         disableInterrupts();
         /* set the command and call a wait for io */
         terminal->t_transm_command = 2 | (((unsigned int) *address) << 8);
-        status = SYSCALL(WAITIO, 7, (ASID - 1), 0);
+        status = SYSCALL(WAITIO, TERMINT, terminalNumber, 0);
         enableInterrupts();
         
         /* check for error */
@@ -148,7 +174,7 @@ static void writeToTerminal(state_PTR state) {
     }
     
 /* return the mutex */
-    SYSCALL (VERHOGEN, (int)mutexSemaphores[40 + (ASID - 1)], 0, 0);
+    ownMutex(FALSE, &(mutexSemaphores[TERMTRANSMSEM(terminalNumber)]));
 }
 
 static void vVerhogen() {
@@ -176,15 +202,20 @@ static void diskGet(state_PTR state) {
 static void writeToPrinter(state_PTR state) {
     char* nextChar = (char*) state->s_a1;
     int stringLength = (int) state->s_a2;
-    int asidIndex = extractASID() - 1;
+    int printerNumber = uProcesses[extractASID() - 1].Tp_printer;
+    /* no printer, nothing to write to */
+    if(printerNumber == NODEVICE) {
+        state->s_v0 = -1;
+        contextSwitch(state);
+    }
     /* get the device */
-    device_PTR printerDevice = (device_PTR) PRINTERDEV + (asidIndex * DEVREGSIZE);
+    device_PTR printerDevice = ((device_PTR) PRINTERDEV) + printerNumber;
     int i = 0;
     int status;
     while(i < stringLength && i > 0) {
         printerDevice->d_command = PRINTCHR;
         printerDevice->d_data0 = nextChar[i];
-        status = SYSCALL(WAITIO, PRNTINT, asidIndex, EMPTY);
+        status = SYSCALL(WAITIO, PRNTINT, printerNumber, EMPTY);
         if(status == READY) {
             i++;
             continue;
@@ -205,20 +236,151 @@ static void getTOD(state_PTR state) {
     LDST (state);
 }
 
-static void terminateUProcess() {
+/*
+* Function: Get Swap - Syscall 30
+* Reports the use of the backing store. Places the percentage of swap 
+* slots holding a page in $v0, and the slots holding a page, reserved 
+* for groups and in total at the addresses in $a1, $a2 and $a3, each 
+* left alone if 0.
+*/
+static void getSwap(state_PTR state) {
+    int used;
+    int reserved;
+    int total;
+    int percent;
+    /* the pagers update the counts under the swap pool semaphore */
+    ownMutex(TRUE, &(swapSemaphore));
+    percent = swapUtilization(&used, &reserved, &total);
+    ownMutex(FALSE, &(swapSemaphore));
+    if(state->s_a1 != 0) {
+        *((int*) state->s_a1) = used;
+    }
+    if(state->s_a2 != 0) {
+        *((int*) state->s_a2) = reserved;
+    }
+    if(state->s_a3 != 0) {
+        *((int*) state->s_a3) = total;
+    }
+    state->s_v0 = percent;
+    LDST (state);
+}
+
+/*
+* Function: Fork UProcess - Syscall 19
+* Clones the calling uproc into a free uproc slot. Only the page table is
+* copied: the parent's resident pages are shared copy on write, pages the
+* parent never touched still come from its tape, and only the pages that
+* sit on the backing store are copied to the child's swap group. The
+* parent gets the child's ASID in v0, the child gets 0; -1 means there is
+* no free slot or swap group.
+*/
+static void forkUProcess(state_PTR state) {
+    int parent = extractASID();
+    int child;
+    int j;
+    int shared;
+    int diskInformation[DISKPARAMS];
+    device_PTR diskDevice = (device_PTR) DISKDEV;
+    state_t processorState;
+    ownMutex(TRUE, &(swapSemaphore));
+    child = allocASID();
+    if((child != NOASID) && (reserveSwapGroup(child) != SUCCESS)) {
+        freePages(freeASID(child));
+        child = NOASID;
+    }
+    if(child == NOASID) {
+        ownMutex(FALSE, &(swapSemaphore));
+        state->s_v0 = -1;
+        contextSwitch(state);
+    }
+    Tproc_PTR parentProc = &(uProcesses[parent - 1]);
+    Tproc_PTR childProc = &(uProcesses[child - 1]);
+    childProc->Tp_sem = 0;
+    childProc->Tp_tape = parentProc->Tp_tape;
+    childProc->Tp_tapeBlocks = parentProc->Tp_tapeBlocks;
+    childProc->Tp_image = parentProc->Tp_image;
+    childProc->Tp_terminal = parentProc->Tp_terminal;
+    childProc->Tp_printer = parentProc->Tp_printer;
+    childProc->Tp_resident = 0;
+    childProc->Tp_hand = 0;
+    childProc->Tp_faults = 0;
+    childProc->Tp_suspended = FALSE;
+    childProc->Tp_pte.header = parentProc->Tp_pte.header;
+    for(j = 0; j < KUSEGPTESIZE; j++) {
+        childProc->Tp_pte.pteTable[j].entryHI = ((parentProc->Tp_pte.pteTable[j].entryHI) & ~ENTRYHIASID) | (child << ASIDMASK);
+        childProc->Tp_pte.pteTable[j].entryLO = ALLOFF | DIRTY;
+    }
+    /* the child sees the same segments, through its own kUseg2 */
+    segt_PTR parentSegment = (segt_PTR) (SEGSTART + (parent * SEGWIDTH));
+    segt_PTR childSegment = (segt_PTR) (SEGSTART + (child * SEGWIDTH));
+    childSegment->kSegOS = parentSegment->kSegOS;
+    childSegment->kUseg3 = parentSegment->kUseg3;
+    childSegment->kUseg2 = &(childProc->Tp_pte);
+    /* no page of ours may be on its way to the disk while we look */
+    settleFrames(parent);
+    shared = forkFrames(parent, child);
+    ownMutex(FALSE, &(swapSemaphore));
+    /* copy what sits on the backing store, through the child's buffer */
+    for(j = 0; j < KUSEGPTESIZE; j++) {
+        if(((shared & PAGEBIT(j)) != 0) || (!isBacked(parent, 2, j))) {
+            continue;
+        }
+        swapLocate(parent, 2, j, diskInformation);
+        diskInformation[PAGELOCATION] = TAPEBUFFER(child);
+        diskInformation[READWRITE] = READBLK;
+        diskOperation(diskInformation, &(diskSemaphores[diskInformation[DISKNUM]]), diskDevice);
+        swapLocate(child, 2, j, diskInformation);
+        diskInformation[PAGELOCATION] = TAPEBUFFER(child);
+        diskInformation[READWRITE] = WRITEBLK;
+        diskOperation(diskInformation, &(diskSemaphores[diskInformation[DISKNUM]]), diskDevice);
+        ownMutex(TRUE, &(swapSemaphore));
+        markBacked(child, 2, j);
+        ownMutex(FALSE, &(swapSemaphore));
+    }
+    /* the child returns from the fork with 0 */
+    copyState(state, &(childProc->Told_trap[SYSTRAP]));
+    childProc->Told_trap[SYSTRAP].s_v0 = 0;
+    childProc->Told_trap[SYSTRAP].s_asid = (state->s_asid & ~ENTRYHIASID) | (child << ASIDMASK);
+    /* but sets up its trap vectors first */
+    processorState.s_status = ALLOFF | IEc | IM | TE;
+    processorState.s_t9 = (memaddr) forkedUProc;
+    processorState.s_pc = (memaddr) forkedUProc;
+    processorState.s_asid = (child << ASIDMASK);
+    processorState.s_sp = UPROCSTACK(child, PROGTRAP);
+    if(SYSCALL(CREATEPROCESS, (int) &(processorState), EMPTY, EMPTY) != SUCCESS) {
+        ownMutex(TRUE, &(swapSemaphore));
+        releaseCowShares(child);
+        releaseImage(child);
+        releaseSwapGroup(child);
+        /* the child never ran on its stacks */
+        freePages(freeASID(child));
+        ownMutex(FALSE, &(swapSemaphore));
+        state->s_v0 = -1;
+        contextSwitch(state);
+    }
+    state->s_v0 = child;
+    contextSwitch(state);
+}
+
+void terminateUProcess() {
     int ASID = ((getENTRYHI() & 0x00000FC0) >> ASIDMASK);
+    memaddr stacks;
     
     /* call dibs */
-    mutex(TRUE, &(swapSemaphore));
-    SYSCALL(PASSEREN, (int) &swapSemaphore, 0, 0);
+    ownMutex(TRUE, &(swapSemaphore));
+    int i;
+    /* let the pager finish writing back or copying any of our pages 
+    before the swap group goes away */
+    settleFrames(ASID);
+    /* the other sharers keep our copy on write pages */
+    releaseCowShares(ASID);
     
     disableInterrupts();
     
     /* set page table and the swap pool entries to invalid */
     int touched = FALSE; /* used to know if we have to clear the tlb or not */
-    int i;
-    for (i = 0; i < 16; i++) {
-        if(pool[i].ASID == ASID){
+    for (i = 0; i < swapPoolSize; i++) {
+        if((pool[i].ASID == ASID) && (pool[i].segmentNumber != 3) && (!pool[i].busy)){
             /* invalidate the entry */
             invalidateEntry(i);
             touched = TRUE;
@@ -228,10 +390,24 @@ static void terminateUProcess() {
         TLBCLR();
     }
     enableInterrupts();
+    /* let go of the shared text pages */
+    releaseImage(ASID);
+    /* the load controller forgets about us */
+    releaseUProcLoad(ASID);
+    /* and our pages on the backing store go back to the swap space */
+    releaseSwapGroup(ASID);
+    /* the ASID can go to the next uproc, but not the stacks we are 
+    running on: another processor could hand them to a new uproc 
+    while we still use them */
+    stacks = freeASID(ASID);
     
     /* we no longer need the semaphore */
-    mutex(FALSE, &(swapSemaphore));
+    disableInterrupts();
+    ownMutex(FALSE, &(swapSemaphore));
     
+    /* the nucleus frees our stacks with our pcb_t, once we are off 
+    them; interrupts are off, so we are still current here */
+    currentProcess->p_heapBlock = stacks;
     /* and to finish it off we add a dash of genocide */
     SYSCALL (TERMINATEPROCESS, 0, 0, 0);
 }
@@ -251,14 +427,24 @@ void mutex(int flag, int *semaphore) {
     }
 } 
 
+/* the same for a mutex: the nucleus records which process holds it, 
+and boosts the holder to the priority of the processes waiting on it */
+void ownMutex(int flag, mutex_PTR semaphore) {
+    if(flag) {
+        SYSCALL(LOCKMUTEX, (int) semaphore, 0, 0);
+    } else {
+        SYSCALL(UNLOCKMUTEX, (int) semaphore, 0, 0);
+    }
+}
+
 /* read in the uproc's .data and .text from the tape */
-void diskOperation(int* diskInformation, int *semaphore, device_PTR diskDevice) {
+void diskOperation(int* diskInformation, mutex_PTR semaphore, device_PTR diskDevice) {
     /* initialize the disk with the disk number */
-    diskDevice = (device_PTR) diskDevice + ((*(diskInformation + DISKNUM)) * DEVREGSIZE);
+    diskDevice = diskDevice + diskInformation[DISKNUM];
     /* save the status before we turn everything off */
     int oldStatus = getSTATUS();
     /* gain control */
-    mutex(TRUE, semaphore);
+    ownMutex(TRUE, semaphore);
     /* turn off interrupts */
     setSTATUS(ALLOFF);
     /* the command for the disk operation to find the specified cylinder, per 5.3 of pops */
@@ -279,13 +465,42 @@ void diskOperation(int* diskInformation, int *semaphore, device_PTR diskDevice)
     /* write the disk */
     diskDevice->d_command = (((*(diskInformation + HEAD)) << COMMANDMASK) | (*(diskInformation + SECTOR))) | (*(diskInformation + READWRITE));
     /* wait for the I/O while we have mutex */
-    status = SYSCALL(WAITIO, DISKINT, (*(diskInformation = DISKNUM)), EMPTY);
+    status = SYSCALL(WAITIO, DISKINT, diskInformation[DISKNUM], EMPTY);
     setSTATUS(oldStatus);
     /* are we ready? */
     if (status != READY) {
         SYSCALL(TERMINATEPROCESS, EMPTY, EMPTY, EMPTY);
     }
     /* release control */
-    mutex(FALSE, semaphore);
+    ownMutex(FALSE, semaphore);
+}
+
+/*
+* Function: Tape Start
+* Issues one command on a uproc's tape without waiting for it: read the
+* block under the head into the buffer, or move the head a block forward
+* or back. A forked uproc shares its parent's tape, so the caller holds
+* the tape's semaphore from the start of the command to its tapeWait. If
+* the tape finishes before tapeWait, the nucleus latches its status.
+*/
+void tapeStart(int tapeNumber, int command, memaddr buffer) {
+    device_PTR tapeDevice = ((device_PTR) TAPEDEV) + tapeNumber;
+    tapeDevice->d_data0 = buffer;
+    tapeDevice->d_command = command;
+}
+
+/* waits for the command started on a tape */
+void tapeWait(int tapeNumber) {
+    int status = SYSCALL(WAITIO, TAPEINT, tapeNumber, EMPTY);
+    /* if we aren't ready, it's over */
+    if(status != READY) {
+        SYSCALL(TERMINATEPROCESS, EMPTY, EMPTY, EMPTY);
+    }
+}
+
+/* one tape command, start to finish */
+void tapeOperation(int tapeNumber, int command, memaddr buffer) {
+    tapeStart(tapeNumber, command, buffer);
+    tapeWait(tapeNumber);
 }
 
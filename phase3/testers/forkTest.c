@@ -0,0 +1,90 @@
+/*	Tests FORK. The parent and the child share the parent's pages of
+ *	kUseg2 copy on write: each must see the pages as they were at the
+ *	fork, and then its own writes only.
+ */
+#include "../../h/const.h"
+#include "../../h/types.h"
+
+#include "/usr/local/include/umps2/umps/libumps.e"
+
+#include "h/tconst.h"
+#include "print.e"
+
+/* clear of the words the pv testers share in kUseg3 */
+int *done = (int *)(SEG3 + 256);
+
+#define		FIRSTPAGE	20
+#define		LASTPAGE	30
+#define		CHILDMARK	100
+#define		PARENTMARK	200
+
+void main() {
+	int i;
+	int child;
+	int corrupt;
+
+	print(WRITETERMINAL, "forkTest starts\n");
+
+	*done = 0;
+
+	/* write into the first word of pages 20-29 of seg2 */
+	for (i = FIRSTPAGE; i < LASTPAGE; i++)
+		*(int *)(SEG2 + (i * PAGESIZE)) = i;
+
+	child = SYSCALL(FORK, 0, 0, 0);
+
+	if (child < 0) {
+		print(WRITETERMINAL, "forkTest error: could not fork\n");
+		SYSCALL(TERMINATE, 0, 0, 0);
+	}
+
+	if (child == 0) {
+		/* the child sees the pages as they were at the fork */
+		corrupt = FALSE;
+		for (i = FIRSTPAGE; i < LASTPAGE; i++)
+			if (*(int *)(SEG2 + (i * PAGESIZE)) != i)
+				corrupt = TRUE;
+		if (corrupt == TRUE)
+			print(WRITETERMINAL, "forkTest error: child did not inherit the pages\n");
+
+		/* and gets a copy of its own of each page it writes */
+		for (i = FIRSTPAGE; i < LASTPAGE; i++)
+			*(int *)(SEG2 + (i * PAGESIZE)) = i + CHILDMARK;
+		for (i = FIRSTPAGE; i < LASTPAGE; i++)
+			if (*(int *)(SEG2 + (i * PAGESIZE)) != i + CHILDMARK)
+				corrupt = TRUE;
+		if (corrupt == FALSE)
+			print(WRITETERMINAL, "forkTest ok: child wrote its copies\n");
+
+		SYSCALL(VSEMVIRT, (int)done, 0, 0);
+		SYSCALL(TERMINATE, 0, 0, 0);
+
+		print(WRITETERMINAL, "forkTest error: child did not terminate\n");
+		HALT();
+	}
+
+	/* the parent writes half the pages, maybe while the child still shares them */
+	for (i = FIRSTPAGE; i < (FIRSTPAGE + LASTPAGE) / 2; i++)
+		*(int *)(SEG2 + (i * PAGESIZE)) = i + PARENTMARK;
+
+	SYSCALL(PSEMVIRT, (int)done, 0, 0);
+
+	/* none of the child's writes may show through */
+	corrupt = FALSE;
+	for (i = FIRSTPAGE; i < LASTPAGE; i++) {
+		if ((i < (FIRSTPAGE + LASTPAGE) / 2) && (*(int *)(SEG2 + (i * PAGESIZE)) != i + PARENTMARK))
+			corrupt = TRUE;
+		if ((i >= (FIRSTPAGE + LASTPAGE) / 2) && (*(int *)(SEG2 + (i * PAGESIZE)) != i))
+			corrupt = TRUE;
+	}
+
+	if (corrupt == FALSE)
+		print(WRITETERMINAL, "forkTest ok: parent's pages survived the child\n");
+	else
+		print(WRITETERMINAL, "forkTest error: child's writes reached the parent\n");
+
+	SYSCALL(TERMINATE, 0, 0, 0);
+
+	print(WRITETERMINAL, "forkTest error: did not terminate\n");
+	HALT();
+}
@@ -14,6 +14,8 @@
 #define WRITEPRINTER	16
 #define GET_TOD			17
 #define TERMINATE		18
+#define FORK			19
+#define GET_SWAP		30
 
 #define SEG0		0x00000000
 #define SEG1		0x40000000
@@ -11,6 +11,7 @@
 void main () {
 	char i;
 	int corrupt;
+	int used, reserved, total, percent;
 
 	print(WRITETERMINAL, "swapTest starts\n");
 
@@ -33,6 +34,13 @@ void main () {
 
 	if (corrupt == FALSE)
 		print(WRITETERMINAL, "swapTest ok: data survived swapper\n");
+
+	/* the backing store holds no more than it has, and our group counts */
+	percent = SYSCALL(GET_SWAP, (int)&used, (int)&reserved, (int)&total);
+	if ((percent < 0) || (percent > 100) || (used > total) || (reserved == 0))
+		print(WRITETERMINAL, "swapTest error: swap usage is off\n");
+	else
+		print(WRITETERMINAL, "swapTest ok: swap usage adds up\n");
 	
 	/* try to access segment ksegOS Should cause termination */
 	/* i = getSTATUS(); */